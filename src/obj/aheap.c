@@ -0,0 +1,111 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+
+#include "ddslib/aheap.h"
+
+#define get_elem(R,O) ((aheap_elem *) &(R)->memb[(char *) (O)])
+#define before(R,P,Q) ((*(R)->cmp)((R)->ctxt, (P), (Q)) < 0)
+
+static void place(aheap *r, size_t i, void *p)
+{
+  r->base[i] = p;
+  get_elem(r, p)->index = i;
+}
+
+/* Move a hole at i towards the root until p can fill it. */
+static void sift_up(aheap *r, size_t i, void *p)
+{
+  while (i > 0) {
+    size_t par = (i - 1) / 2;
+    void *q = r->base[par];
+    if (!before(r, p, q)) break;
+    place(r, i, q);
+    i = par;
+  }
+  place(r, i, p);
+}
+
+/* Move a hole at i towards the leaves until p can fill it. */
+static void sift_down(aheap *r, size_t i, void *p)
+{
+  size_t c;
+  while ((c = 2 * i + 1) < r->size) {
+    if (c + 1 < r->size && before(r, r->base[c + 1], r->base[c]))
+      c++;
+    if (!before(r, r->base[c], p)) break;
+    place(r, i, r->base[c]);
+    i = c;
+  }
+  place(r, i, p);
+}
+
+void aheap_term(aheap *r)
+{
+  free(r->base);
+  r->base = 0;
+  r->size = r->cap = 0;
+}
+
+int aheap_reserve(aheap *r, size_t n)
+{
+  void **nb;
+  if (n <= r->cap) return 0;
+  nb = realloc(r->base, n * sizeof *nb);
+  if (!nb) return -1;
+  r->base = nb;
+  r->cap = n;
+  return 0;
+}
+
+int aheap_insert(aheap *r, void *p)
+{
+  if (r->size == r->cap &&
+      aheap_reserve(r, r->cap ? r->cap * 2 : 16) < 0)
+    return -1;
+  sift_up(r, r->size++, p);
+  return 0;
+}
+
+void aheap_remove(aheap *r, void *p)
+{
+  size_t i = get_elem(r, p)->index;
+  void *last = r->base[--r->size];
+  if (i == r->size) return;
+  if (i > 0 && before(r, last, r->base[(i - 1) / 2]))
+    sift_up(r, i, last);
+  else
+    sift_down(r, i, last);
+}
+
+void *aheap_pop(aheap *r)
+{
+  void *p;
+  if (r->size == 0) return 0;
+  p = r->base[0];
+  aheap_remove(r, p);
+  return p;
+}
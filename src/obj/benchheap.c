@@ -0,0 +1,288 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+/* Compare the heap implementations on a hold model: a heap of n
+   elements repeatedly has its first element removed and reinserted
+   later, so priorities never fall below the last minimum and the
+   radix heap applies too.  Then compare a heap with a timing wheel on
+   timeouts, most of which are cancelled and rescheduled before they
+   expire.  Sizes may be given as arguments.  Each element takes about
+   200 bytes, so the default sizes stop at a million, and 100M needs
+   about 20 gigabytes. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ddslib/bheap.h"
+#include "ddslib/aheap.h"
+#include "ddslib/dheap.h"
+#include "ddslib/radixheap.h"
+#include "ddslib/twheel.h"
+
+bheap_DECL(tbh, struct myelem);
+
+struct myelem {
+  int64_t key;
+  int scheduled;
+  bheap_elem bh;
+  tbh_elem tb;
+  aheap_elem ah;
+  dheap_elem dh;
+  radixheap_elem rh;
+  twheel_elem tw;
+};
+
+static int mycmp(void *ctxt, const void *a, const void *b)
+{
+  const struct myelem *x = a, *y = b;
+  return x->key < y->key ? -1 : x->key > y->key;
+}
+
+static uint64_t rng_state;
+
+static int64_t next_delay(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state % 1000000;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run_bheap(struct myelem *e, size_t n, size_t ops)
+{
+  bheap h;
+  bheap_init(&h, struct myelem, bh, NULL, &mycmp);
+  for (size_t i = 0; i < n; i++)
+    bheap_insert(&h, &e[i]);
+  double start = now();
+  for (size_t i = 0; i < ops; i++) {
+    struct myelem *p = bheap_pop(&h);
+    p->key += next_delay();
+    bheap_insert(&h, p);
+  }
+  return now() - start;
+}
+
+#define TCMP(C, A, B) ((A)->key < (B)->key ? -1 : (A)->key > (B)->key)
+
+bheap_IMPL(tbh, struct myelem, tb, TCMP);
+
+static double run_typed(struct myelem *e, size_t n, size_t ops)
+{
+  tbh_heap h;
+  tbh_init(&h, NULL);
+  for (size_t i = 0; i < n; i++)
+    tbh_insert(&h, &e[i]);
+  double start = now();
+  for (size_t i = 0; i < ops; i++) {
+    struct myelem *p = tbh_pop(&h);
+    p->key += next_delay();
+    tbh_insert(&h, p);
+  }
+  return now() - start;
+}
+
+static double run_aheap(struct myelem *e, size_t n, size_t ops)
+{
+  aheap h;
+  aheap_init(&h, struct myelem, ah, NULL, &mycmp);
+  if (aheap_reserve(&h, n) < 0) return -1;
+  for (size_t i = 0; i < n; i++)
+    aheap_insert(&h, &e[i]);
+  double start = now();
+  for (size_t i = 0; i < ops; i++) {
+    struct myelem *p = aheap_pop(&h);
+    p->key += next_delay();
+    aheap_insert(&h, p);
+  }
+  double t = now() - start;
+  aheap_term(&h);
+  return t;
+}
+
+static double run_dheap(struct myelem *e, size_t n, size_t ops)
+{
+  dheap h;
+  dheap_init(&h, struct myelem, dh);
+  if (dheap_reserve(&h, n) < 0) return -1;
+  for (size_t i = 0; i < n; i++)
+    dheap_insert(&h, &e[i], e[i].key);
+  double start = now();
+  for (size_t i = 0; i < ops; i++) {
+    struct myelem *p = dheap_pop(&h);
+    p->key += next_delay();
+    dheap_insert(&h, p, p->key);
+  }
+  double t = now() - start;
+  dheap_term(&h);
+  return t;
+}
+
+static double run_radixheap(struct myelem *e, size_t n, size_t ops)
+{
+  radixheap h;
+  radixheap_init(&h, struct myelem, rh);
+  for (size_t i = 0; i < n; i++)
+    radixheap_insert(&h, &e[i], e[i].key);
+  double start = now();
+  for (size_t i = 0; i < ops; i++) {
+    struct myelem *p = radixheap_pop(&h);
+    p->key += next_delay();
+    radixheap_insert(&h, p, p->key);
+  }
+  return now() - start;
+}
+
+/* Each operation reschedules a timer, whether pending or not, up to a
+   million ticks ahead, and time advances by one tick every 16
+   operations. */
+#define TIMER_RANGE 1000000
+
+static double run_bheap_timers(struct myelem *e, size_t n, size_t ops)
+{
+  bheap h;
+  int64_t tick = 0;
+  bheap_init(&h, struct myelem, bh, NULL, &mycmp);
+  for (size_t i = 0; i < n; i++) {
+    e[i].key = next_delay() % TIMER_RANGE + 1;
+    e[i].scheduled = 1;
+    bheap_insert(&h, &e[i]);
+  }
+  double start = now();
+  for (size_t i = 0; i < ops; i++) {
+    struct myelem *p = &e[i % n];
+    if (p->scheduled)
+      bheap_remove(&h, p);
+    p->key = tick + next_delay() % TIMER_RANGE + 1;
+    p->scheduled = 1;
+    bheap_insert(&h, p);
+    if (i % 16 == 15) {
+      tick++;
+      while ((p = bheap_peek(&h)) && p->key <= tick) {
+        bheap_pop(&h);
+        p->scheduled = 0;
+      }
+    }
+  }
+  return now() - start;
+}
+
+static void expire(void *ctxt, void *p)
+{
+  ((struct myelem *) p)->scheduled = 0;
+}
+
+static double run_twheel(struct myelem *e, size_t n, size_t ops)
+{
+  twheel w;
+  if (twheel_init(&w, struct myelem, tw, 8, 4, 0) < 0) return -1;
+  for (size_t i = 0; i < n; i++) {
+    e[i].tw.slot = NULL;
+    twheel_schedule(&w, &e[i], next_delay() % TIMER_RANGE + 1);
+  }
+  double start = now();
+  for (size_t i = 0; i < ops; i++) {
+    struct myelem *p = &e[i % n];
+    twheel_schedule(&w, p, twheel_now(&w) + next_delay() % TIMER_RANGE + 1);
+    if (i % 16 == 15)
+      twheel_advance(&w, twheel_now(&w) + 1, &expire, NULL);
+  }
+  double t = now() - start;
+  twheel_term(&w);
+  return t;
+}
+
+typedef double run_func(struct myelem *, size_t, size_t);
+
+static int table(const char *title, const char *const *names,
+                 run_func *const *runs, int nruns,
+                 const char *const *sizes, int nsizes)
+{
+  printf("%12s", title);
+  for (int r = 0; r < nruns; r++)
+    printf(" %8s ns/op", names[r]);
+  printf("\n");
+
+  for (int s = 0; s < nsizes; s++) {
+    size_t n = strtoul(sizes[s], NULL, 10);
+    size_t ops = n < 1000000 ? 1000000 : n;
+    struct myelem *e = malloc((n ? n : 1) * sizeof *e);
+    if (!e) {
+      fprintf(stderr, "Could not allocate %zu elements.\n", n);
+      return -1;
+    }
+    printf("%12zu", n);
+    for (int r = 0; r < nruns; r++) {
+      rng_state = 88172645463325252u;
+      for (size_t i = 0; i < n; i++)
+        e[i].key = next_delay();
+      double t = n ? (*runs[r])(e, n, ops) : 0;
+      printf(" %14.1f", t < 0 ? -1 : t * 1e9 / ops);
+      fflush(stdout);
+    }
+    printf("\n");
+    free(e);
+  }
+  return 0;
+}
+
+static const char *const default_sizes[] = {
+  "1000", "10000", "100000", "1000000",
+};
+
+int main(int argc, const char *const *argv)
+{
+  const char *const *sizes = argv + 1;
+  int nsizes = argc - 1;
+  if (nsizes == 0) {
+    sizes = default_sizes;
+    nsizes = sizeof default_sizes / sizeof default_sizes[0];
+  }
+
+  static run_func *const holds[] = {
+    &run_bheap, &run_typed, &run_aheap, &run_dheap, &run_radixheap,
+  };
+  static const char *const hold_names[] = {
+    "bheap", "typed", "aheap", "dheap", "radix",
+  };
+  if (table("hold size", hold_names, holds, 5, sizes, nsizes) < 0)
+    return EXIT_FAILURE;
+
+  static run_func *const timers[] = { &run_bheap_timers, &run_twheel };
+  static const char *const timer_names[] = { "bheap", "twheel" };
+  if (table("timers", timer_names, timers, 2, sizes, nsizes) < 0)
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
@@ -24,12 +24,48 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <assert.h>
 
 #include "ddslib/bheap.h"
 
 #define get_elem(R,O) ((bheap_elem *) &(R)->memb[(char *) (O)])
 
+#ifdef ddslib_BHEAP_STATS
+#define count(R,F) ((void) ((R)->stats.F++))
+#define note_sift(R,N)                                  \
+  ((void) ((R)->stats.sifts++,                          \
+           (R)->stats.sift_steps += (N),                \
+           (R)->stats.sift_max < (N) ?                  \
+           (R)->stats.sift_max = (N) : 0))
+#else
+#define count(R,F) ((void) 0)
+#define note_sift(R,N) ((void) (N))
+#endif
+
+#define DEAD 1u
+#define is_dead(R,O) (get_elem((R),(O))->flags & DEAD)
+
+/* Marks an element being popped in a batch. */
+#define TAKEN 2u
+#define is_taken(R,O) (get_elem((R),(O))->flags & TAKEN)
+
+/* Compare two elements, falling back on their insertion order if
+   required.  Insertion numbers wrap around, so they are compared by
+   their difference, which is correct while the two were inserted
+   fewer than half the range of unsigned long apart. */
+static int order(const bheap *r, const void *p, const void *q)
+{
+  int c = (*r->cmp)(r->ctxt, p, q);
+  if (c == 0 && r->fifo) {
+    unsigned long d = get_elem(r, p)->seq - get_elem(r, q)->seq;
+    return d == 0 ? 0 : d > ULONG_MAX / 2 ? -1 : 1;
+  }
+  return c;
+}
+
 #define fix_holder(R,M,N)                                               \
   if ((M)->child[N]) get_elem((R),(M)->child[N])->holder = &(M)->child[N]
 
@@ -38,11 +74,20 @@ static void swap(bheap *r, void *p, void *q)
   bheap_elem *pm = get_elem(r, p);
   bheap_elem *qm = get_elem(r, q);
   bheap_elem tmp = *qm;
+  unsigned pf = pm->flags;
+  unsigned long ps = pm->seq;
 
   assert(p != q);
+  count(r, swaps);
 
+  /* The links belong to the positions, but the flags and sequence
+     numbers stay with the elements. */
   *qm = *pm;
   *pm = tmp;
+  qm->flags = tmp.flags;
+  qm->seq = tmp.seq;
+  pm->flags = pf;
+  pm->seq = ps;
 
   if (pm->parent == p) {
     qm->child[pm->holder - pm->child] = p;
@@ -88,7 +133,9 @@ static void swap(bheap *r, void *p, void *q)
 static int swap_with_parent(bheap *r, void *p)
 {
   void *q = get_elem(r, p)->parent;
-  if (!q || (*r->cmp)(r->ctxt, q, p) < 0) return 0;
+  if (!q) return 0;
+  count(r, compares);
+  if (order(r, q, p) < 0) return 0;
   swap(r, p, q);
   return 1;
 }
@@ -98,12 +145,6 @@ static int swap_with_child(bheap *r, void *p, int n)
 {
   void *q = get_elem(r, p)->child[n];
   if (!q || (*r->cmp)(r->ctxt, q, p) > 0) return 0;
-#ifdef DEBUG
-  fprintf(stderr, "Swapping %p (%s)",
-          p, r->print ? r->print(r->ctxt, p) : "");
-  fprintf(stderr, " with child %d (%p; %s)...\n", n, q,
-          r->print ? r->print(r->ctxt, q) : "");
-#endif
   swap(r, p, q);
   return 1;
 }
@@ -114,9 +155,9 @@ static int swap_with_children(bheap *r, void *p)
   bheap_elem *pm = get_elem(r, p);
   void *c = p;
 
-  if (pm->child[0] && (*r->cmp)(r->ctxt, pm->child[0], c) <= 0)
+  if (pm->child[0] && (count(r, compares), order(r, pm->child[0], c) <= 0))
     c = pm->child[0];
-  if (pm->child[1] && (*r->cmp)(r->ctxt, pm->child[1], c) <= 0)
+  if (pm->child[1] && (count(r, compares), order(r, pm->child[1], c) <= 0))
     c = pm->child[1];
   if (c == p)
     return 0;
@@ -124,6 +165,34 @@ static int swap_with_children(bheap *r, void *p)
   return 1;
 }
 
+static void sift_up(bheap *r, void *p)
+{
+  unsigned long n = 0;
+  while (swap_with_parent(r, p))
+    n++;
+  note_sift(r, n);
+}
+
+static void sift_down(bheap *r, void *p)
+{
+  unsigned long n = 0;
+  while (swap_with_children(r, p))
+    n++;
+  note_sift(r, n);
+}
+
+/* Move an element in whichever direction applies, as one sift. */
+static void sift(bheap *r, void *p)
+{
+  unsigned long n = 0;
+  while (swap_with_parent(r, p))
+    n++;
+  if (n == 0)
+    while (swap_with_children(r, p))
+      n++;
+  note_sift(r, n);
+}
+
 static unsigned fls(unsigned i)
 {
   unsigned r = 0;
@@ -160,25 +229,14 @@ static void find_last(bheap *r)
   ptrdiff_t i;
 
   for ( ; ; ) {
-#ifdef DEBUG
-    fprintf(stderr, "Seeking from %p (%s)...\n", n,
-            r->print ? r->print(r->ctxt, n) : "");
-#endif
+    count(r, find_last_steps);
     nm = get_elem(r, n);
     p = nm->parent;
-    if (!p) {
-#ifdef DEBUG
-      fprintf(stderr, "\tWe have no parent!\n");
-#endif
+    if (!p)
       break;
-    }
     pm = get_elem(r, p);
     i = nm->holder - pm->child;
     if (i) {
-#ifdef DEBUG
-      fprintf(stderr, "\tWe're the right child of %p (%s)!\n", p,
-              r->print ? r->print(r->ctxt, p) : "");
-#endif
       n = pm->child[0];
       break;
     }
@@ -186,21 +244,31 @@ static void find_last(bheap *r)
   }
 
   while (nm = get_elem(r, n), nm->child[0] || nm->child[1]) {
-#ifdef DEBUG
-    fprintf(stderr, "%p (%s) down %s to\n", n,
-            r->print ? r->print(r->ctxt, n) : "",
-            nm->child[1] ? "right" : "left");
-#endif
+    count(r, find_last_steps);
     n = nm->child[!!nm->child[1]];
   }
-#ifdef DEBUG
-  fprintf(stderr, "%p (%s).\n", n, r->print ? r->print(r->ctxt, n) : "");
-#endif
 
   r->last = n;
 #endif
 }
 
+void bheap_setup(bheap *r, size_t memb, void *ctxt,
+                 int (*cmp)(void *, const void *, const void *))
+{
+  r->first = r->last = NULL;
+  r->memb = memb;
+  r->ctxt = ctxt;
+  r->cmp = cmp;
+  r->size = 0;
+  r->print = NULL;
+  r->reclaim = NULL;
+  r->dead = 0;
+  r->limit = 0;
+  r->fifo = 0;
+  r->seq = 0;
+  bheap_reset_stats(r);
+}
+
 void bheap_insert(bheap *r, void *p)
 {
   void *parent;
@@ -212,14 +280,111 @@ void bheap_insert(bheap *r, void *p)
   pm->holder = pp;
   pm->child[0] = pm->child[1] = NULL;
   pm->parent = parent;
+  pm->flags = 0;
+  pm->seq = r->seq++;
 
   r->last = p;
 
-  while (swap_with_parent(r, p))
-    ;
+  count(r, inserts);
+  sift_up(r, p);
 }
 
-void bheap_remove(bheap *r, void *p)
+/* Attach an element as a leaf, without sorting it. */
+static void attach(bheap *r, void *p, void **holder, void *parent)
+{
+  bheap_elem *pm = get_elem(r, p);
+  *holder = p;
+  pm->holder = holder;
+  pm->child[0] = pm->child[1] = NULL;
+  pm->parent = parent;
+  pm->flags = 0;
+  pm->seq = r->seq++;
+  r->last = p;
+}
+
+/* Sort a tree of the right shape, sorting each subtree before
+   letting its root descend. */
+static void heapify(bheap *r, void *p)
+{
+  bheap_elem *pm = get_elem(r, p);
+
+  if (pm->child[0])
+    heapify(r, pm->child[0]);
+  if (pm->child[1])
+    heapify(r, pm->child[1]);
+  sift_down(r, p);
+}
+
+void bheap_build(bheap *r, void *const *elems, size_t n)
+{
+  size_t k;
+
+  assert(r->size == 0);
+  if (n == 0) return;
+
+  /* Element k has children 2k+1 and 2k+2. */
+  attach(r, elems[0], &r->first, NULL);
+  for (k = 1; k < n; k++) {
+    void *par = elems[(k - 1) / 2];
+    attach(r, elems[k], &get_elem(r, par)->child[(k - 1) & 1], par);
+  }
+  r->size = n;
+  count(r, builds);
+  heapify(r, r->first);
+}
+
+#define get_next(O,N) (*(void **) ((char *) (O) + (N)))
+
+void bheap_build_list(bheap *r, void *first, size_t next)
+{
+  void *p, *par = first;
+  unsigned side = 0;
+
+  assert(r->size == 0);
+  if (!first) return;
+
+  /* The list is in level order, so a second cursor, advancing at half
+     the speed, yields each element's parent. */
+  attach(r, first, &r->first, NULL);
+  r->size = 1;
+  for (p = get_next(first, next); p; p = get_next(p, next)) {
+    attach(r, p, &get_elem(r, par)->child[side], par);
+    r->size++;
+    if (side) {
+      par = get_next(par, next);
+      side = 0;
+    } else {
+      side = 1;
+    }
+  }
+  count(r, builds);
+  heapify(r, r->first);
+}
+
+void bheap_insert_many(bheap *r, void *const *elems, size_t n)
+{
+  size_t k, total = r->size + n;
+
+  /* Rebuilding costs about two comparisons per element, while each
+     insertion may cost one per level. */
+  if (n * fls(total) <= 2 * total) {
+    for (k = 0; k < n; k++)
+      bheap_insert(r, elems[k]);
+    return;
+  }
+
+  for (k = 0; k < n; k++) {
+    void *parent;
+    void **pp = find_pos(r, ++r->size, &parent);
+    attach(r, elems[k], pp, parent);
+  }
+  count(r, builds);
+  heapify(r, r->first);
+}
+
+/* Detach an element, putting the last one in its place, and return
+   that one, or NULL if the element was the last. */
+static void *take(bheap *r, void *p)
 {
   void *q = r->last;
 
@@ -227,11 +392,6 @@ void bheap_remove(bheap *r, void *p)
   if (p != q)
     swap(r, p, q);
 
-#ifdef DEBUG
-  fprintf(stderr, "\nHaving swapped the offender:\n");
-  bheap_debug(r, 0);
-#endif
-
   /* Find the new last element. */
   if (--r->size > 1)
     find_last(r);
@@ -240,43 +400,380 @@ void bheap_remove(bheap *r, void *p)
   else
     r->last = NULL;
 
-#ifdef DEBUG
-  fprintf(stderr, "\nHaving recomputed the last:\n");
-  bheap_debug(r, 0);
-#endif
-
   /* Detach the offending element. */
   *get_elem(r, p)->holder = NULL;
 
-#ifdef DEBUG
-  fprintf(stderr, "\nHaving eliminated the offender:\n");
-  bheap_debug(r, 0);
-#endif
+  return p != q ? q : NULL;
+}
 
-  if (p != q) {
-    /* Let the previous swapped element ascend. */
-    while (swap_with_parent(r, q))
-      ;
+void bheap_remove(bheap *r, void *p)
+{
+  void *q;
+
+  if (is_dead(r, p))
+    r->dead--;
+  count(r, removes);
+  q = take(r, p);
+
+  /* Let the previous swapped element ascend, or else descend. */
+  if (q)
+    sift(r, q);
+}
+
+void bheap_decrease(bheap *r, void *p)
+{
+  sift_up(r, p);
+}
+
+void bheap_increase(bheap *r, void *p)
+{
+  sift_down(r, p);
+}
+
+void bheap_update(bheap *r, void *p)
+{
+  sift(r, p);
+}
+
+/* The element replacing the first can only descend. */
+static void *take_first(bheap *r)
+{
+  void *p = r->first, *q = take(r, p);
+
+  if (q)
+    sift_down(r, q);
+  return p;
+}
+
+static void *pop_first(bheap *r)
+{
+  count(r, pops);
+  return take_first(r);
+}
 
-    /* Let the previous swapped element descend. */
-    while (swap_with_children(r, q))
-      ;
+/* Reclaim cancelled elements from the front, so that the first, if
+   any, is live. */
+static void *skip_dead(bheap *r)
+{
+  while (r->first && is_dead(r, r->first)) {
+    void *p = take_first(r);
+    count(r, reclaims);
+    r->dead--;
+    get_elem(r, p)->flags = 0;
+    if (r->reclaim)
+      (*r->reclaim)(r->ctxt, p);
   }
+  return r->first;
+}
 
-#ifdef DEBUG
-  fprintf(stderr, "\nHaving resorted the old last:\n");
-  bheap_debug(r, 0);
-#endif
+void *bheap_peek(bheap *r)
+{
+  return skip_dead(r);
 }
 
 void *bheap_pop(bheap *r)
 {
-  void *p = bheap_peek(r);
-  if (p)
+  return skip_dead(r) ? pop_first(r) : NULL;
+}
+
+/* Let a taken element sink to the bottom as a gap, promoting the
+   earlier of its live children at each level, which costs one
+   comparison rather than two. */
+static void sink(bheap *r, void *p)
+{
+  unsigned long n = 0;
+
+  for ( ; ; ) {
+    bheap_elem *pm = get_elem(r, p);
+    void *c = NULL;
+    unsigned s;
+
+    for (s = 0; s < 2; s++) {
+      void *d = pm->child[s];
+      if (!d || is_taken(r, d)) continue;
+      if (c && (count(r, compares), order(r, d, c) >= 0)) continue;
+      c = d;
+    }
+    if (!c) break;
+    swap(r, c, p);
+    n++;
+  }
+  note_sift(r, n);
+}
+
+/* Detach a taken element as take does, and clear its mark. */
+static void *untake(bheap *r, void *p)
+{
+  void *q = take(r, p);
+  get_elem(r, p)->flags &= ~TAKEN;
+  return q;
+}
+
+/* Pop live elements up to max, and not later than limit, if given.
+   The first elements are taken as gaps sinking below the live ones,
+   and then the gaps are filled from the end of the heap in one pass,
+   rather than restoring the heap after each. */
+static size_t pop_batch(bheap *r, const void *limit, void **out, size_t max)
+{
+  size_t n = 0, i, j;
+
+  while (n < max && skip_dead(r)) {
+    for (i = n; n < max; n++) {
+      void *p = r->first;
+      if (get_elem(r, p)->flags & (DEAD | TAKEN)) break;
+      if (limit && (*r->cmp)(r->ctxt, p, limit) > 0) break;
+      count(r, pops);
+      get_elem(r, p)->flags |= TAKEN;
+      out[n] = p;
+      sink(r, p);
+    }
+    if (n == i) break;
+
+    /* A gap's ancestors were filled, if they were gaps, before it,
+       having been taken after it, so its filler only has to rise
+       past live elements. */
+    for (j = n; j-- > i; ) {
+      void *q;
+      while (r->last && is_taken(r, r->last))
+        untake(r, r->last);
+      if (!is_taken(r, out[j])) continue;
+      q = untake(r, out[j]);
+      sift_up(r, q);
+    }
+  }
+  return n;
+}
+
+size_t bheap_pop_many(bheap *r, void **out, size_t max)
+{
+  return pop_batch(r, NULL, out, max);
+}
+
+size_t bheap_pop_until(bheap *r, const void *limit, void **out, size_t max)
+{
+  return pop_batch(r, limit, out, max);
+}
+
+void bheap_lazy(bheap *r, unsigned percent,
+                void (*reclaim)(void *ctxt, void *))
+{
+  r->limit = percent;
+  r->reclaim = reclaim;
+}
+
+/* Gather the live elements of a subtree into a list linked through
+   their second child pointers, and reclaim the rest. */
+static void *gather(bheap *r, void *p, void *list)
+{
+  bheap_elem *pm = get_elem(r, p);
+  void *c0 = pm->child[0], *c1 = pm->child[1];
+
+  if (c0)
+    list = gather(r, c0, list);
+  if (c1)
+    list = gather(r, c1, list);
+  if (pm->flags & DEAD) {
+    count(r, reclaims);
+    pm->flags = 0;
+    if (r->reclaim)
+      (*r->reclaim)(r->ctxt, p);
+    return list;
+  }
+  pm->child[1] = list;
+  return p;
+}
+
+/* Rebuild the heap without its cancelled elements.  The list gives
+   the level order of the new tree, and a second cursor, advancing at
+   half the speed, yields each element's parent.  A parent's link is
+   not overwritten until its second child is attached, when the cursor
+   no longer needs it. */
+static void compact(bheap *r)
+{
+  void *list = r->first ? gather(r, r->first, NULL) : NULL;
+  void *p, *next, *par = list;
+  bheap_elem *pm, *parm;
+  unsigned side = 0;
+
+  r->first = r->last = NULL;
+  r->size = r->dead = 0;
+  count(r, builds);
+  if (!list) return;
+
+  pm = get_elem(r, list);
+  r->first = r->last = list;
+  pm->holder = &r->first;
+  pm->parent = pm->child[0] = NULL;
+  r->size = 1;
+  for (p = pm->child[1]; p; p = next) {
+    pm = get_elem(r, p);
+    parm = get_elem(r, par);
+    next = pm->child[1];
+    pm->child[0] = NULL;
+    pm->parent = par;
+    pm->holder = &parm->child[side];
+    r->last = p;
+    r->size++;
+    if (side) {
+      par = parm->child[1];
+      parm->child[1] = p;
+      side = 0;
+    } else {
+      parm->child[0] = p;
+      side = 1;
+    }
+  }
+
+  /* Clear the links of elements that got no second child. */
+  for ( ; par; par = next) {
+    parm = get_elem(r, par);
+    next = parm->child[1];
+    parm->child[1] = NULL;
+  }
+  heapify(r, r->first);
+}
+
+void bheap_cancel(bheap *r, void *p)
+{
+  bheap_elem *pm = get_elem(r, p);
+
+  if (pm->flags & DEAD) return;
+  count(r, cancels);
+  if (r->limit == 0) {
     bheap_remove(r, p);
+    if (r->reclaim)
+      (*r->reclaim)(r->ctxt, p);
+    return;
+  }
+  pm->flags |= DEAD;
+  r->dead++;
+  if (r->dead * 100 > (size_t) r->limit * r->size)
+    compact(r);
+}
+
+/* The frontier of an iterator is a small array-based heap of
+   candidates. */
+static void front_push(const bheap *r, void **f, size_t *n, void *p)
+{
+  size_t i = (*n)++;
+
+  while (i > 0 && order(r, p, f[(i - 1) / 2]) < 0) {
+    f[i] = f[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  f[i] = p;
+}
+
+static void *front_pop(const bheap *r, void **f, size_t *n)
+{
+  void *top = f[0], *p = f[--*n];
+  size_t i = 0, c;
+
+  while ((c = 2 * i + 1) < *n) {
+    if (c + 1 < *n && order(r, f[c + 1], f[c]) < 0)
+      c++;
+    if (order(r, f[c], p) >= 0)
+      break;
+    f[i] = f[c];
+    i = c;
+  }
+  f[i] = p;
+  return top;
+}
+
+static int front_reserve(bheap_iter *it, size_t n)
+{
+  void **nf;
+
+  if (n <= it->cap) return 0;
+  if (n < it->cap * 2) n = it->cap * 2;
+  if (n < 16) n = 16;
+  nf = realloc(it->front, n * sizeof *nf);
+  if (!nf) return -1;
+  it->front = nf;
+  it->cap = n;
+  return 0;
+}
+
+int bheap_iter_init(bheap_iter *it, const bheap *r, size_t hint)
+{
+  it->heap = r;
+  it->front = NULL;
+  it->n = it->cap = 0;
+  it->failed = 0;
+  if (!r->first) return 0;
+  if (front_reserve(it, hint + 1) < 0) return -1;
+  front_push(r, it->front, &it->n, r->first);
+  return 0;
+}
+
+void bheap_iter_term(bheap_iter *it)
+{
+  free(it->front);
+  it->front = NULL;
+  it->n = it->cap = 0;
+}
+
+void *bheap_iter_next(bheap_iter *it)
+{
+  const bheap *r = it->heap;
+  void *p;
+  bheap_elem *pm;
+
+  /* Each step takes one candidate and adds at most two, and cancelled
+     elements are passed over. */
+  do {
+    if (it->n == 0) return NULL;
+    if (front_reserve(it, it->n + 1) < 0) {
+      it->failed = 1;
+      return NULL;
+    }
+    p = front_pop(r, it->front, &it->n);
+    pm = get_elem(r, p);
+    if (pm->child[0])
+      front_push(r, it->front, &it->n, pm->child[0]);
+    if (pm->child[1])
+      front_push(r, it->front, &it->n, pm->child[1]);
+  } while (pm->flags & DEAD);
   return p;
 }
 
+ptrdiff_t bheap_topk(const bheap *r, void **out, size_t k)
+{
+  bheap_iter it;
+  size_t got = 0;
+  void *p;
+
+  if (k > r->size - r->dead)
+    k = r->size - r->dead;
+  if (k == 0)
+    return 0;
+
+  /* Reserve enough that the frontier never grows. */
+  if (bheap_iter_init(&it, r, k + r->dead) < 0) return -1;
+  while (got < k && (p = bheap_iter_next(&it)))
+    out[got++] = p;
+  bheap_iter_term(&it);
+  return got;
+}
+
+void bheap_reset_stats(bheap *r)
+{
+#ifdef ddslib_BHEAP_STATS
+  memset(&r->stats, 0, sizeof r->stats);
+#endif
+}
+
+int bheap_stats(const bheap *r, bheap_counters *out)
+{
+#ifdef ddslib_BHEAP_STATS
+  *out = r->stats;
+  return 0;
+#else
+  return -1;
+#endif
+}
+
 static void print_branch(FILE *out, bheap *r, void *elem)
 {
   bheap_elem *em;
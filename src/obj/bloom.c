@@ -0,0 +1,139 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ddslib/bloom.h"
+
+/* Each code selects one block, which is the size of a typical cache
+   line, and sets one bit in each of its words.  Testing a code
+   therefore touches only one line, and the per-word operations are
+   independent, so the compiler can vectorise them. */
+#define WORDS 8
+#define DEFAULT_BITS 10
+
+typedef struct {
+  uint64_t word[WORDS];
+} block;
+
+struct bloom_str {
+  block *base;
+  void *mem;
+  size_t nblocks, cap;
+};
+
+/* Odd multipliers used to select a bit within each word */
+static const uint32_t salt[WORDS] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+/* Hash codes supplied by users are often weak, so spread their bits
+   over the whole word before use. */
+static inline uint64_t mix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= UINT64_C(0xff51afd7ed558ccd);
+  h ^= h >> 33;
+  h *= UINT64_C(0xc4ceb9fe1a85ec53);
+  h ^= h >> 33;
+  return h;
+}
+
+static inline block *get_block(bloom self, uint64_t m)
+{
+  return &self->base[((m >> 32) * (uint64_t) self->nblocks) >> 32];
+}
+
+static inline uint64_t get_bit(uint32_t k, int i)
+{
+  return (uint64_t) 1 << ((uint32_t) (k * salt[i]) >> 26);
+}
+
+bloom bloom_open(size_t n, unsigned bits)
+{
+  if (bits == 0) bits = DEFAULT_BITS;
+
+  bloom self = malloc(sizeof *self);
+  if (!self) return NULL;
+
+  const size_t perblock = sizeof(block) * 8;
+  self->nblocks = n / perblock * bits + (n % perblock * bits + perblock - 1)
+    / perblock;
+  if (self->nblocks < 1)
+    self->nblocks = 1;
+  if (self->nblocks > UINT32_MAX)
+    self->nblocks = UINT32_MAX;
+  self->cap = n;
+
+  /* Align to the block size, so no test straddles two lines. */
+  self->mem = malloc(self->nblocks * sizeof(block) + sizeof(block) - 1);
+  if (!self->mem) {
+    free(self);
+    return NULL;
+  }
+  uintptr_t addr = (uintptr_t) self->mem;
+  addr = (addr + sizeof(block) - 1) / sizeof(block) * sizeof(block);
+  self->base = (block *) addr;
+  bloom_clear(self);
+  return self;
+}
+
+void bloom_close(bloom self)
+{
+  if (!self) return;
+  free(self->mem);
+  free(self);
+}
+
+void bloom_clear(bloom self)
+{
+  memset(self->base, 0, self->nblocks * sizeof(block));
+}
+
+size_t bloom_capacity(bloom self)
+{
+  return self->cap;
+}
+
+void bloom_add(bloom self, size_t hash)
+{
+  uint64_t m = mix(hash);
+  block *b = get_block(self, m);
+  for (int i = 0; i < WORDS; i++)
+    b->word[i] |= get_bit(m, i);
+}
+
+_Bool bloom_tst(bloom self, size_t hash)
+{
+  uint64_t m = mix(hash);
+  const block *b = get_block(self, m);
+  uint64_t miss = 0;
+  for (int i = 0; i < WORDS; i++)
+    miss |= get_bit(m, i) & ~b->word[i];
+  return !miss;
+}
@@ -0,0 +1,73 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#ifndef aheap_INCLUDED
+#define aheap_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+  /* An element records its position in the array, so it can be
+     removed without a search. */
+  typedef struct {
+    size_t index;
+  } aheap_elem;
+
+  typedef struct {
+    void **base;
+    size_t size, cap;
+    void *ctxt;
+    int (*cmp)(void *, const void *, const void *);
+    size_t memb;
+  } aheap;
+
+#define aheap_init(R, T, MEMB, OBJ, CMP)        \
+  ((void) ((R)->base = 0,                       \
+           (R)->size = (R)->cap = 0u,           \
+           (R)->memb = offsetof(T, MEMB),       \
+           (R)->ctxt = (OBJ),                   \
+           (R)->cmp = (CMP)))
+
+  /* Release the array, but not the elements. */
+  void aheap_term(aheap *);
+
+  /* Ensure space for at least n elements.  Returns 0 on success, or
+     -1 on failure. */
+  int aheap_reserve(aheap *, size_t n);
+
+  /* Returns 0 on success, or -1 if the array could not grow. */
+  int aheap_insert(aheap *, void *);
+  void aheap_remove(aheap *, void *);
+  void *aheap_pop(aheap *);
+#define aheap_peek(R) ((R)->size ? (R)->base[0] : 0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -35,31 +35,290 @@ extern "C" {
   typedef struct {
     void *child[2], *parent;
     void **holder;
+    unsigned flags;
+    unsigned long seq;
   } bheap_elem;
 
+  /* Counts of operations and their costs, kept only if
+     ddslib_BHEAP_STATS is defined when compiling both the library and
+     its users.  A sift moves an element through zero or more
+     levels; repositioning an element counts as one sift, whichever
+     way it moves.  Cancelled elements later discarded from the front
+     or by compaction count as reclaims, not pops. */
+  typedef struct {
+    unsigned long inserts, removes, pops, cancels, reclaims, builds;
+    unsigned long compares, swaps, find_last_steps;
+    unsigned long sifts, sift_steps, sift_max;
+  } bheap_counters;
+
   typedef struct {
     void *first, *last;
     void *ctxt;
     int (*cmp)(void *, const void *, const void *);
     char *(*print)(void *, const void *);
     size_t memb, size;
+    void (*reclaim)(void *, void *);
+    size_t dead;
+    unsigned limit;
+    int fifo;
+    unsigned long seq;
+#ifdef ddslib_BHEAP_STATS
+    bheap_counters stats;
+#endif
   } bheap;
 
-#define bheap_init(R, T, MEMB, OBJ, CMP)        \
-  ((void) ((R)->first = (R)->last = 0,          \
-           (R)->memb = offsetof(T, MEMB),       \
-           (R)->ctxt = (OBJ),                   \
-           (R)->cmp = (CMP),                    \
-           (R)->size = 0u,                      \
-           (R)->print = 0))
+  void bheap_setup(bheap *, size_t memb, void *ctxt,
+                   int (*cmp)(void *, const void *, const void *));
+#define bheap_init(R, T, MEMB, OBJ, CMP) \
+  bheap_setup((R), offsetof(T, MEMB), (OBJ), (CMP))
+
+  /* Break ties between equal elements in order of insertion, without
+     calling the comparison function again.  Use before inserting any
+     elements.  Insertion numbers wrap, so the order of equal elements
+     is kept only while they were inserted fewer than ULONG_MAX / 2
+     insertions apart. */
+#define bheap_fifo(R) ((void) ((R)->fifo = 1))
 
   void bheap_insert(bheap *, void *);
+
+  /* Build an empty heap from an array of n elements in linear time. */
+  void bheap_build(bheap *, void *const *, size_t n);
+
+  /* Build an empty heap from a null-terminated list, in which each
+     element points to the next with a member at the given offset. */
+  void bheap_build_list(bheap *, void *, size_t next);
+#define bheap_build_dllist(R, H, T, M) \
+  bheap_build_list((R), dllist_first(H), offsetof(T, M.next))
+
+  /* Insert n elements, rebuilding the heap if that is cheaper than
+     inserting them one at a time. */
+  void bheap_insert_many(bheap *, void *const *, size_t n);
   void bheap_remove(bheap *, void *);
+
+  /* Let cancelled elements linger until they reach the first
+     position, or until they make up more than the given percentage of
+     the heap, when it is rebuilt without them.  Zero cancels eagerly.
+     Each cancelled element is passed with the context to reclaim, if
+     not null, once the heap has let go of it. */
+  void bheap_lazy(bheap *, unsigned percent,
+                  void (*reclaim)(void *ctxt, void *));
+  void bheap_cancel(bheap *, void *);
+
+  /* Restore an element's position after its ordering has changed.
+     The second form is for an element that should now be earlier in
+     the sequence, and the third for one that should now be later. */
+  void bheap_update(bheap *, void *);
+  void bheap_decrease(bheap *, void *);
+  void bheap_increase(bheap *, void *);
   void *bheap_pop(bheap *);
-#define bheap_peek(R) ((R)->first)
+
+  /* Pop up to max elements into an array, returning how many.  The
+     heap is restored once for the batch, with about half the
+     comparisons of repeated bheap_pop. */
+  size_t bheap_pop_many(bheap *, void **out, size_t max);
+
+  /* Pop up to max elements that are not later in the sequence than
+     limit, returning how many. */
+  size_t bheap_pop_until(bheap *, const void *limit, void **out, size_t max);
+
+  /* Get the first k elements in order, without removing them.
+     Returns how many, or -1 on failure. */
+  ptrdiff_t bheap_topk(const bheap *, void **out, size_t k);
+
+  /* Visit elements in order without changing the heap, which must not
+     be modified until the iterator is terminated.  The hint is how
+     many elements are likely to be visited.  Initialisation returns 0
+     on success, or -1 on failure.  Getting the next element yields
+     NULL at the end, or if it cannot allocate memory, when failed is
+     set. */
+  typedef struct {
+    const bheap *heap;
+    void **front;
+    size_t n, cap;
+    int failed;
+  } bheap_iter;
+
+  int bheap_iter_init(bheap_iter *, const bheap *, size_t hint);
+  void *bheap_iter_next(bheap_iter *);
+  void bheap_iter_term(bheap_iter *);
+  void *bheap_peek(bheap *);
 
   void bheap_debug(bheap *, int);
 
+  /* Copy the counters of a heap.  Returns 0 on success, or -1 if the
+     library keeps no counters.  Comparisons made while iterating are
+     not counted. */
+  int bheap_stats(const bheap *, bheap_counters *);
+  void bheap_reset_stats(bheap *);
+
+  /* Declare a heap specialised for elements of type T, with a prefix
+     P for its types and functions.  T contains a member of type
+     P_elem. */
+#define bheap_DECL(P, T)                                \
+  typedef struct {                                      \
+    T *child[2], *parent, **holder;                     \
+  } P##_elem;                                           \
+  typedef struct {                                      \
+    T *first, *last;                                    \
+    void *ctxt;                                         \
+    size_t size;                                        \
+  } P##_heap;                                           \
+  void P##_init(P##_heap *, void *ctxt);                \
+  void P##_insert(P##_heap *, T *);                     \
+  void P##_remove(P##_heap *, T *);                     \
+  void P##_update(P##_heap *, T *);                     \
+  T *P##_pop(P##_heap *);                               \
+  T *P##_peek(P##_heap *)
+
+  /* Define the functions of a specialised heap, whose elements link
+     through member M, and are ordered by CMP(ctxt, a, b), an
+     expression or macro yielding an int as bheap's comparison
+     functions do. */
+#define bheap_IMPL(P, T, M, CMP)                                        \
+  static void P##_swap(P##_heap *r, T *p, T *q)                         \
+  {                                                                     \
+    P##_elem tmp = q->M, *pm = &p->M, *qm = &q->M;                      \
+    int i;                                                              \
+                                                                        \
+    q->M = p->M;                                                        \
+    p->M = tmp;                                                         \
+    if (pm->parent == p) {                                              \
+      qm->child[pm->holder - pm->child] = p;                            \
+      *qm->holder = q;                                                  \
+    } else if (qm->parent == q) {                                       \
+      pm->child[qm->holder - qm->child] = q;                            \
+      *pm->holder = p;                                                  \
+    } else {                                                            \
+      *pm->holder = p;                                                  \
+      *qm->holder = q;                                                  \
+    }                                                                   \
+    for (i = 0; i < 2; i++) {                                           \
+      if (pm->child[i]) {                                               \
+        pm->child[i]->M.holder = &pm->child[i];                         \
+        pm->child[i]->M.parent = p;                                     \
+      }                                                                 \
+      if (qm->child[i]) {                                               \
+        qm->child[i]->M.holder = &qm->child[i];                         \
+        qm->child[i]->M.parent = q;                                     \
+      }                                                                 \
+    }                                                                   \
+    if (p == r->last)                                                   \
+      r->last = q;                                                      \
+    else if (q == r->last)                                              \
+      r->last = p;                                                      \
+  }                                                                     \
+                                                                        \
+  static int P##_up(P##_heap *r, T *p)                                  \
+  {                                                                     \
+    T *q = p->M.parent;                                                 \
+    if (!q || CMP(r->ctxt, q, p) < 0) return 0;                         \
+    P##_swap(r, p, q);                                                  \
+    return 1;                                                           \
+  }                                                                     \
+                                                                        \
+  static int P##_down(P##_heap *r, T *p)                                \
+  {                                                                     \
+    T *c = p;                                                           \
+    if (p->M.child[0] && CMP(r->ctxt, p->M.child[0], c) <= 0)           \
+      c = p->M.child[0];                                                \
+    if (p->M.child[1] && CMP(r->ctxt, p->M.child[1], c) <= 0)           \
+      c = p->M.child[1];                                                \
+    if (c == p) return 0;                                               \
+    P##_swap(r, c, p);                                                  \
+    return 1;                                                           \
+  }                                                                     \
+                                                                        \
+  void P##_init(P##_heap *r, void *ctxt)                                \
+  {                                                                     \
+    r->first = r->last = 0;                                             \
+    r->ctxt = ctxt;                                                     \
+    r->size = 0;                                                        \
+  }                                                                     \
+                                                                        \
+  T *P##_peek(P##_heap *r)                                              \
+  {                                                                     \
+    return r->first;                                                    \
+  }                                                                     \
+                                                                        \
+  void P##_insert(P##_heap *r, T *p)                                    \
+  {                                                                     \
+    T **pp = &r->first, *parent = 0;                                    \
+    size_t i = ++r->size;                                               \
+    int f = 0;                                                          \
+                                                                        \
+    /* Follow the bits of the new position below the top one. */        \
+    while (i >> f > 1)                                                  \
+      f++;                                                              \
+    while (f-- > 0) {                                                   \
+      parent = *pp;                                                     \
+      pp = &parent->M.child[(i >> f) & 1u];                             \
+    }                                                                   \
+    *pp = p;                                                            \
+    p->M.holder = pp;                                                   \
+    p->M.child[0] = p->M.child[1] = 0;                                  \
+    p->M.parent = parent;                                               \
+    r->last = p;                                                        \
+    while (P##_up(r, p))                                                \
+      ;                                                                 \
+  }                                                                     \
+                                                                        \
+  static T *P##_take(P##_heap *r, T *p)                                 \
+  {                                                                     \
+    T *q = r->last, *n;                                                 \
+                                                                        \
+    if (p != q)                                                         \
+      P##_swap(r, p, q);                                                \
+    if (--r->size > 1) {                                                \
+      /* Climb while a left child, cross over, and descend. */          \
+      for (n = r->last; n->M.parent; n = n->M.parent)                   \
+        if (n->M.holder != &n->M.parent->M.child[0]) {                  \
+          n = n->M.parent->M.child[0];                                  \
+          break;                                                        \
+        }                                                               \
+      while (n->M.child[0] || n->M.child[1])                            \
+        n = n->M.child[n->M.child[1] != 0];                             \
+      r->last = n;                                                      \
+    } else {                                                            \
+      r->last = r->size ? r->first : 0;                                 \
+    }                                                                   \
+    *p->M.holder = 0;                                                   \
+    return p != q ? q : 0;                                              \
+  }                                                                     \
+                                                                        \
+  void P##_remove(P##_heap *r, T *p)                                    \
+  {                                                                     \
+    T *q = P##_take(r, p);                                              \
+    if (q) {                                                            \
+      while (P##_up(r, q))                                              \
+        ;                                                               \
+      while (P##_down(r, q))                                            \
+        ;                                                               \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  void P##_update(P##_heap *r, T *p)                                    \
+  {                                                                     \
+    if (P##_up(r, p)) {                                                 \
+      while (P##_up(r, p))                                              \
+        ;                                                               \
+    } else {                                                            \
+      while (P##_down(r, p))                                            \
+        ;                                                               \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  T *P##_pop(P##_heap *r)                                               \
+  {                                                                     \
+    T *p = r->first, *q;                                                \
+    if (!p) return 0;                                                   \
+    if ((q = P##_take(r, p)))                                           \
+      while (P##_down(r, q))                                            \
+        ;                                                               \
+    return p;                                                           \
+  }                                                                     \
+                                                                        \
+  struct tm
+
 #ifdef __cplusplus
 }
 #endif
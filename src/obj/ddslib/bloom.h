@@ -0,0 +1,56 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#ifndef bloom_INCLUDED
+#define bloom_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+  typedef struct bloom_str *bloom;
+
+  /* Create a filter expected to hold n hash codes, using approximately
+     bits bits per code.  Zero selects a default.  Returns NULL on
+     failure. */
+  bloom bloom_open(size_t n, unsigned bits);
+  void bloom_close(bloom);
+  void bloom_clear(bloom);
+
+  /* The number of codes the filter was sized for */
+  size_t bloom_capacity(bloom);
+
+  void bloom_add(bloom, size_t hash);
+
+  // Returns false if the code was definitely never added.
+  _Bool bloom_tst(bloom, size_t hash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
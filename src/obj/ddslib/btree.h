@@ -26,6 +26,8 @@
 #ifndef btree_INCLUDED
 #define btree_INCLUDED
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -77,17 +79,13 @@ extern "C" {
   (btree_checkchild(M, (OP), btree_LEFT),                               \
    btree_checkchild(M, (OP), btree_RIGHT))
 
-#define btree_IMPL(P, T, KT, M, K, CMP)                                 \
+/* Define the functions shared by both kinds of tree. */
+#define btree_IMPL_COMMON(P, T, KT, M, K, CMP)                          \
   void P##_init(T *np)                                                  \
   {                                                                     \
     btree_init(M, np);                                                  \
   }                                                                     \
                                                                         \
-  void P##_link(T *np)                                                  \
-  {                                                                     \
-    btree_link(M, np);                                                  \
-  }                                                                     \
-                                                                        \
   P##_elem *P##_links(T *np)                                            \
   {                                                                     \
     return &np->M;                                                      \
@@ -98,30 +96,11 @@ extern "C" {
     return np->K;                                                       \
   }                                                                     \
                                                                         \
-  btree_dir P##_dir(T *np)                                              \
-  {                                                                     \
-    return btree_dir(M, np);                                            \
-  }                                                                     \
-                                                                        \
   T *P##_child(T *np, btree_dir d)                                      \
   {                                                                     \
     return btree_child(M, np, d);                                       \
   }                                                                     \
                                                                         \
-  T *P##_parent(T *np)                                                  \
-  {                                                                     \
-    return btree_parent(M, np);                                         \
-  }                                                                     \
-                                                                        \
-  void P##_check(T *root)                                               \
-  {                                                                     \
-    if (!root)                                                          \
-      return;                                                           \
-    btree_checknode(M, root);                                           \
-    P##_check(root->M.child[0]);                                        \
-    P##_check(root->M.child[1]);                                        \
-  }                                                                     \
-                                                                        \
   P##_elem *P##_find(T *parent, T **rootp,                              \
                      KT key, P##_elem *res, void *cmpctxt)              \
   {                                                                     \
@@ -138,6 +117,34 @@ extern "C" {
     }                                                                   \
     res->holder = rootp;                                                \
     return res;                                                         \
+  }                                                                     \
+  struct tm
+
+#define btree_IMPL(P, T, KT, M, K, CMP)                                 \
+  btree_IMPL_COMMON(P, T, KT, M, K, CMP);                               \
+                                                                        \
+  void P##_link(T *np)                                                  \
+  {                                                                     \
+    btree_link(M, np);                                                  \
+  }                                                                     \
+                                                                        \
+  btree_dir P##_dir(T *np)                                              \
+  {                                                                     \
+    return btree_dir(M, np);                                            \
+  }                                                                     \
+                                                                        \
+  T *P##_parent(T *np)                                                  \
+  {                                                                     \
+    return btree_parent(M, np);                                         \
+  }                                                                     \
+                                                                        \
+  void P##_check(T *root)                                               \
+  {                                                                     \
+    if (!root)                                                          \
+      return;                                                           \
+    btree_checknode(M, root);                                           \
+    P##_check(root->M.child[0]);                                        \
+    P##_check(root->M.child[1]);                                        \
   }                                                                     \
                                                                         \
   T *P##_remove(T *np, void *cmpctxt)                                   \
@@ -193,8 +200,217 @@ extern "C" {
       return P##_extchild(np->M.child[dir], btree_opp(dir));            \
                                                                         \
     return P##_extparent(np, btree_opp(dir));                           \
+  }                                                                     \
+  struct tm
+
+/* Define the functions of a red-black tree, which stays balanced.
+   The colour of each node is held in the low bit of its parent
+   pointer, set for black, so elements must be at least 2-byte
+   aligned. */
+#define btree_RBIMPL(P, T, KT, M, K, CMP)                               \
+  btree_IMPL_COMMON(P, T, KT, M, K, CMP);                               \
+                                                                        \
+  static T *P##_rbpar(T *np)                                            \
+  {                                                                     \
+    return (T *) ((uintptr_t) np->M.parent & ~(uintptr_t) 1);           \
+  }                                                                     \
+                                                                        \
+  static int P##_isblack(T *np)                                         \
+  {                                                                     \
+    return !np || ((uintptr_t) np->M.parent & 1);                       \
   }                                                                     \
                                                                         \
+  static void P##_setpar(T *np, T *par, int black)                      \
+  {                                                                     \
+    np->M.parent = (T *) ((uintptr_t) par | (black ? 1 : 0));           \
+  }                                                                     \
+                                                                        \
+  static void P##_setblack(T *np, int black)                            \
+  {                                                                     \
+    P##_setpar(np, P##_rbpar(np), black);                               \
+  }                                                                     \
+                                                                        \
+  static void P##_attach(T *np, T *par, T **holder)                     \
+  {                                                                     \
+    *holder = np;                                                       \
+    if (np) {                                                           \
+      np->M.holder = holder;                                            \
+      P##_setpar(np, par, P##_isblack(np));                             \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  /* Move a node down towards dir, and its child from the other side    \
+     into its place. */                                                 \
+  static void P##_rotate(T *np, btree_dir dir)                          \
+  {                                                                     \
+    T *up = np->M.child[btree_opp(dir)];                                \
+                                                                        \
+    P##_attach(up->M.child[dir], np, &np->M.child[btree_opp(dir)]);     \
+    P##_attach(up, P##_rbpar(np), np->M.holder);                        \
+    P##_attach(np, up, &up->M.child[dir]);                              \
+  }                                                                     \
+                                                                        \
+  void P##_link(T *np)                                                  \
+  {                                                                     \
+    T *par, *gp, *unc;                                                  \
+    btree_dir d;                                                        \
+                                                                        \
+    /* Start red, and resolve any red parent. */                        \
+    *np->M.holder = np;                                                 \
+    P##_setblack(np, 0);                                                \
+    while ((par = P##_rbpar(np)) && !P##_isblack(par)) {                \
+      gp = P##_rbpar(par);                                              \
+      d = P##_dir(par);                                                 \
+      unc = gp->M.child[btree_opp(d)];                                  \
+      if (!P##_isblack(unc)) {                                          \
+        P##_setblack(par, 1);                                           \
+        P##_setblack(unc, 1);                                           \
+        P##_setblack(gp, 0);                                            \
+        np = gp;                                                        \
+        continue;                                                       \
+      }                                                                 \
+      if (P##_dir(np) != d) {                                           \
+        P##_rotate(par, d);                                             \
+        par = np;                                                       \
+      }                                                                 \
+      P##_setblack(par, 1);                                             \
+      P##_setblack(gp, 0);                                              \
+      P##_rotate(gp, btree_opp(d));                                     \
+      break;                                                            \
+    }                                                                   \
+    if (!P##_rbpar(np))                                                 \
+      P##_setblack(np, 1);                                              \
+  }                                                                     \
+                                                                        \
+  btree_dir P##_dir(T *np)                                              \
+  {                                                                     \
+    return (btree_dir) (np->M.holder - P##_rbpar(np)->M.child);         \
+  }                                                                     \
+                                                                        \
+  T *P##_parent(T *np)                                                  \
+  {                                                                     \
+    return P##_rbpar(np);                                               \
+  }                                                                     \
+                                                                        \
+  static int P##_rbcheck(T *np)                                         \
+  {                                                                     \
+    int lh, rh;                                                         \
+                                                                        \
+    if (!np)                                                            \
+      return 1;                                                         \
+    btree_checknode(M, np);                                             \
+    assert(!np->M.child[0] || P##_rbpar(np->M.child[0]) == np);         \
+    assert(!np->M.child[1] || P##_rbpar(np->M.child[1]) == np);         \
+    assert(P##_isblack(np) || (P##_isblack(np->M.child[0]) &&           \
+                               P##_isblack(np->M.child[1])));           \
+    lh = P##_rbcheck(np->M.child[0]);                                   \
+    rh = P##_rbcheck(np->M.child[1]);                                   \
+    assert(lh == rh);                                                   \
+    return lh + P##_isblack(np);                                        \
+  }                                                                     \
+                                                                        \
+  void P##_check(T *root)                                               \
+  {                                                                     \
+    assert(!root || P##_isblack(root));                                 \
+    P##_rbcheck(root);                                                  \
+  }                                                                     \
+                                                                        \
+  T *P##_remove(T *np, void *cmpctxt)                                   \
+  {                                                                     \
+    T *x, *xp, *sib, *succ;                                             \
+    T **holder;                                                         \
+    int black;                                                          \
+    btree_dir d;                                                        \
+                                                                        \
+    /* A node with two children first swaps places with its             \
+       successor, which has no left child. */                           \
+    if (np->M.child[0] && np->M.child[1]) {                             \
+      T *l = np->M.child[0], *r = np->M.child[1];                       \
+      T *par = P##_rbpar(np), **h = np->M.holder;                       \
+      int nb = P##_isblack(np);                                         \
+                                                                        \
+      succ = r;                                                         \
+      while (succ->M.child[0])                                          \
+        succ = succ->M.child[0];                                        \
+      x = succ->M.child[1];                                             \
+      black = P##_isblack(succ);                                        \
+      if (succ == r) {                                                  \
+        P##_attach(succ, par, h);                                       \
+        P##_setblack(succ, nb);                                         \
+        P##_attach(np, succ, &succ->M.child[1]);                        \
+      } else {                                                          \
+        T *sp = P##_rbpar(succ), **sh = succ->M.holder;                 \
+        P##_attach(succ, par, h);                                       \
+        P##_setblack(succ, nb);                                         \
+        P##_attach(r, succ, &succ->M.child[1]);                         \
+        P##_attach(np, sp, sh);                                         \
+      }                                                                 \
+      P##_attach(l, succ, &succ->M.child[0]);                           \
+      P##_setblack(np, black);                                          \
+      np->M.child[0] = 0;                                               \
+      P##_attach(x, np, &np->M.child[1]);                               \
+    }                                                                   \
+                                                                        \
+    /* Now the node has at most one child, which takes its place. */    \
+    x = np->M.child[np->M.child[0] ? 0 : 1];                            \
+    xp = P##_rbpar(np);                                                 \
+    holder = np->M.holder;                                              \
+    black = P##_isblack(np);                                            \
+    P##_attach(x, xp, holder);                                          \
+    btree_init(M, np);                                                  \
+    if (!black)                                                         \
+      return np;                                                        \
+                                                                        \
+    /* The path through x is one black short. */                        \
+    d = xp ? (btree_dir) (holder - xp->M.child) : btree_LEFT;           \
+    while (xp && P##_isblack(x)) {                                      \
+      sib = xp->M.child[btree_opp(d)];                                  \
+      if (!P##_isblack(sib)) {                                          \
+        P##_setblack(sib, 1);                                           \
+        P##_setblack(xp, 0);                                            \
+        P##_rotate(xp, d);                                              \
+        sib = xp->M.child[btree_opp(d)];                                \
+      }                                                                 \
+      if (P##_isblack(sib->M.child[0]) &&                               \
+          P##_isblack(sib->M.child[1])) {                               \
+        P##_setblack(sib, 0);                                           \
+        x = xp;                                                         \
+        xp = P##_rbpar(x);                                              \
+        if (xp)                                                         \
+          d = P##_dir(x);                                               \
+        continue;                                                       \
+      }                                                                 \
+      if (P##_isblack(sib->M.child[btree_opp(d)])) {                    \
+        P##_setblack(sib->M.child[d], 1);                               \
+        P##_setblack(sib, 0);                                           \
+        P##_rotate(sib, btree_opp(d));                                  \
+        sib = xp->M.child[btree_opp(d)];                                \
+      }                                                                 \
+      P##_setblack(sib, P##_isblack(xp));                               \
+      P##_setblack(xp, 1);                                              \
+      P##_setblack(sib->M.child[btree_opp(d)], 1);                      \
+      P##_rotate(xp, d);                                                \
+      break;                                                            \
+    }                                                                   \
+    if (x)                                                              \
+      P##_setblack(x, 1);                                               \
+    return np;                                                          \
+  }                                                                     \
+                                                                        \
+  T *P##_next(T *np, btree_dir dir)                                     \
+  {                                                                     \
+    T *par;                                                             \
+                                                                        \
+    if (np->M.child[dir]) {                                             \
+      np = np->M.child[dir];                                            \
+      while (np->M.child[btree_opp(dir)])                               \
+        np = np->M.child[btree_opp(dir)];                               \
+      return np;                                                        \
+    }                                                                   \
+    while ((par = P##_rbpar(np)) && np->M.holder == &par->M.child[dir]) \
+      np = par;                                                         \
+    return par;                                                         \
+  }                                                                     \
   struct tm
 
 #ifdef __cplusplus
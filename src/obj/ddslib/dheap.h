@@ -0,0 +1,90 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#ifndef dheap_INCLUDED
+#define dheap_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+  /* The number of children per node, 4 or 8.  The library and its
+     users must agree on it. */
+#ifndef dheap_ARITY
+#define dheap_ARITY 4
+#endif
+
+#if dheap_ARITY != 4 && dheap_ARITY != 8
+#error "dheap_ARITY must be 4 or 8"
+#endif
+
+  /* An element records its position in the array, so it can be
+     removed without a search. */
+  typedef struct {
+    size_t index;
+  } dheap_elem;
+
+  /* Priorities are held apart from the elements, in an array arranged
+     so that the children of each node share a cache line. */
+  typedef struct {
+    int64_t *key;
+    void **item;
+    void *mem;
+    size_t size, cap, memb;
+  } dheap;
+
+#define dheap_init(R, T, MEMB)                  \
+  ((void) ((R)->key = 0,                        \
+           (R)->item = 0,                       \
+           (R)->mem = 0,                        \
+           (R)->size = (R)->cap = 0u,           \
+           (R)->memb = offsetof(T, MEMB)))
+
+  /* Release the arrays, but not the elements. */
+  void dheap_term(dheap *);
+
+  /* Ensure space for at least n elements.  Returns 0 on success, or
+     -1 on failure. */
+  int dheap_reserve(dheap *, size_t n);
+
+  /* Insert an element with the given priority, lowest first.  Returns
+     0 on success, or -1 if the arrays could not grow. */
+  int dheap_insert(dheap *, void *, int64_t key);
+  void dheap_remove(dheap *, void *);
+  void *dheap_pop(dheap *);
+#define dheap_peek(R) ((R)->size ? (R)->item[0] : 0)
+
+  /* Get the priority of the first element.  Returns false if the
+     heap is empty. */
+  _Bool dheap_peekkey(const dheap *, int64_t *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
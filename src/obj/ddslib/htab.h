@@ -51,6 +51,10 @@ extern "C" {
     htab_OKAY, htab_REPLACED, htab_ERROR
   } htab_rplc;
 
+  typedef enum {
+    htab_ABSENT, htab_REMOVED, htab_FAILED
+  } htab_popc;
+
   typedef struct htab_str *htab;
 
   htab htab_open(size_t n, void *,
@@ -60,8 +64,20 @@ extern "C" {
                  htab_obj (*copy_value)(void *ctxt, htab_const),
                  void (*release_key)(void *ctxt, htab_obj),
                  void (*release_value)(void *ctxt, htab_obj val));
+
+  /* Supply a function to test keys for equality, to be used in
+     preference to the comparison function.  NULL reverts to the
+     comparison function. */
+  void htab_seteq(htab, _Bool (*eq)(void *, htab_const, htab_const));
+
   void htab_close(htab);
+
+  /* Remove all entries.  Without release functions, this takes
+     constant time, apart from returning memory to the system, which
+     the second form avoids by retaining it for reuse.  Removing
+     entries individually keeps their memory until none remain. */
   void htab_clear(htab);
+  void htab_clear_keep_capacity(htab);
 
   typedef enum { htab_REMOVE = 1, htab_STOP = 2 } htab_apprc;
 
@@ -71,8 +87,10 @@ extern "C" {
   // Returns true if found.
   _Bool htab_get(htab, htab_const, htab_obj *);
 
-  // Returns true if found.
-  _Bool htab_pop(htab, htab_const, htab_obj *);
+  /* Returns htab_REMOVED or htab_ABSENT, or htab_FAILED if the table
+     is read-only or memory to copy nodes shared with a snapshot could
+     not be allocated, leaving the table unchanged. */
+  htab_popc htab_pop(htab, htab_const, htab_obj *);
 
   htab_rplc htab_rpl(htab, htab_const, htab_obj *, htab_const val);
 
@@ -82,9 +100,73 @@ extern "C" {
   // Returns true if found.
 #define htab_tst(T,K) htab_get((T),(K),0)
 
-  // Returns true if found.
+  // Returns as htab_pop.
 #define htab_del(T,K) htab_pop((T),(K),0)
 
+  /* Compute a key's hash code with the table's hash function.  The
+     code can be passed to the *_hashed forms of the functions above,
+     on this table or on any other with the same hash function and
+     context, to avoid computing it again. */
+  size_t htab_hash_key(htab, htab_const);
+  _Bool htab_get_hashed(htab, htab_const, size_t hash, htab_obj *);
+  htab_popc htab_pop_hashed(htab, htab_const, size_t hash, htab_obj *);
+  htab_rplc htab_rpl_hashed(htab, htab_const, size_t hash,
+                            htab_obj *, htab_const val);
+  _Bool htab_put_hashed(htab, htab_const, size_t hash, htab_const val);
+
+  /* Maintain a Bloom filter of the keys' hash codes, using
+     approximately the given number of bits per key, so that most
+     unsuccessful searches do not visit the table.  Zero removes the
+     filter.  Returns true if successful. */
+  _Bool htab_bloom(htab, unsigned bits);
+
+  /* Make the table read-only, holding its entries in a dense array
+     located by a minimal perfect hash of their hash codes, so that
+     each search examines one slot.  Subsequent insertions and
+     removals fail, and clearing has no effect.  Returns true if
+     successful, or if already frozen; the table is unchanged on
+     failure. */
+  _Bool htab_freeze(htab);
+
+  /* Hold the entries in a trie whose nodes can be shared with
+     snapshots, from now on.  Existing entries are moved, so call it
+     just after opening.  Returns true if successful. */
+  _Bool htab_persist(htab);
+
+  /* Get a read-only view of a persistent table in constant time,
+     unaffected by later changes.  Release it with htab_close.
+     Returns NULL on failure, or if the table is not persistent. */
+  htab htab_snapshot(htab);
+
+  /* Ensure the table has at least the given number of buckets,
+     redistributing the entries by their stored hash codes.  Returns
+     true if successful; tables not arranged in buckets are
+     unaffected. */
+  _Bool htab_reserve(htab, size_t n);
+
+  /* Convert keys or values to and from a sequence of bytes.  size
+     gives the length of an encoding, and put writes it.  get decodes
+     a value of the given length into a new object, as if produced by
+     the table's copy function, returning false if malformed or out of
+     memory. */
+  typedef struct {
+    size_t (*size)(void *ctxt, htab_const);
+    void (*put)(void *ctxt, htab_const, unsigned char *);
+    _Bool (*get)(void *ctxt, htab_obj *, const unsigned char *, size_t);
+    void *ctxt;
+  } htab_codec;
+
+  /* Write all entries to a file descriptor, in large chunks.  Returns
+     0 on success, or -1 on error, with errno set. */
+  int htab_save(htab, int fd, const htab_codec *key, const htab_codec *val);
+
+  /* Add entries written by htab_save, replacing any with the same
+     keys.  The table is grown to fit them first, and decoded objects
+     are kept without further copying.  Returns 0 on success, or -1 on
+     error, with errno set, and with the entries read so far
+     added. */
+  int htab_load(htab, int fd, const htab_codec *key, const htab_codec *val);
+
 #if __STDC_VERSION__ < 199901L
   /* Wrapper functions are as usual. */
 #define htab_DECL(SUFFIX, KEY_TYPE, VALUE_TYPE, CONST_VALUE_TYPE,       \
@@ -132,7 +214,8 @@ extern "C" {
                                                                         \
   STORAGE VALUE_TYPE htab_pop##SUFFIX(htab self, KEY_TYPE key) {        \
     htab_obj val;                                                       \
-    if (htab_pop(self, (htab_const) { .KEY_MEMBER = key }, &val))       \
+    if (htab_pop(self, (htab_const) { .KEY_MEMBER = key }, &val) ==     \
+        htab_REMOVED)                                                   \
       return val.VALUE_MEMBER;                                          \
     return NULL_VALUE;                                                  \
   }                                                                     \
@@ -158,7 +241,8 @@ extern "C" {
   }                                                                     \
                                                                         \
   STORAGE _Bool htab_del##SUFFIX(htab self, KEY_TYPE key) {             \
-    return htab_del(self, (htab_const) { .KEY_MEMBER = key });          \
+    return htab_del(self, (htab_const) { .KEY_MEMBER = key }) ==        \
+      htab_REMOVED;                                                     \
   }                                                                     \
                                                                         \
   struct tm
@@ -195,6 +279,12 @@ extern "C" {
   htab_obj htab_copy_wcs(void *ctxt, htab_const);
   void htab_release_free(void *, htab_obj key);
 
+  /* Codecs for null-terminated strings, wide strings (in native byte
+     order), integers (as 64 bits) and pointers (meaningful only to
+     the same process) */
+  extern const htab_codec htab_codec_str, htab_codec_wcs;
+  extern const htab_codec htab_codec_uint, htab_codec_int, htab_codec_ptr;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,101 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#ifndef kmerge_INCLUDED
+#define kmerge_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+  /* A run yields its records in order, one per call, and null at its
+     end.  Each record must remain valid until the next call. */
+  typedef struct {
+    const void *(*next)(void *ctxt);
+    void *ctxt;
+  } kmerge_run;
+
+  /* A run over an array of n records of the given size */
+  typedef struct {
+    const char *pos, *end;
+    size_t size;
+  } kmerge_array;
+
+  void kmerge_array_init(kmerge_run *, kmerge_array *,
+                         const void *base, size_t n, size_t size);
+
+  /* A run over records of the given size read from a file descriptor,
+     through a buffer of cap records.  error is set to an errno value
+     if reading fails, or if the file ends part-way through a
+     record. */
+  typedef struct {
+    int fd, error;
+    char *buf;
+    size_t size, cap, len, pos;
+  } kmerge_file;
+
+  /* Returns 0 on success, or -1 if the buffer cannot be allocated. */
+  int kmerge_file_init(kmerge_run *, kmerge_file *,
+                       int fd, size_t size, size_t cap);
+
+  /* Release the buffer, but do not close the descriptor. */
+  void kmerge_file_term(kmerge_file *);
+
+  /* The runs form the leaves of a tree of losers, each internal node
+     recording the run that lost the match played there, so that
+     replacing the overall winner takes one comparison per level. */
+  typedef struct {
+    kmerge_run *runs;
+    const void **cur;
+    size_t *loser;
+    size_t k, size;
+    int pending;
+    void *ctxt;
+    int (*cmp)(void *, const void *, const void *);
+  } kmerge;
+
+  /* Merge k runs of records of the given size, which are ordered by
+     the comparison function and context as for bheap.  Equal records
+     emerge in the order of their runs.  The runs are not copied, and
+     must outlive the merge.  Returns 0 on success, or -1 on
+     failure. */
+  int kmerge_init(kmerge *, kmerge_run *runs, size_t k, size_t size,
+                  void *ctxt, int (*cmp)(void *, const void *, const void *));
+  void kmerge_term(kmerge *);
+
+  /* Get the next record, or null at the end.  It remains valid until
+     the next call. */
+  const void *kmerge_next(kmerge *);
+
+  /* Copy up to max records to an array, returning how many. */
+  size_t kmerge_read(kmerge *, void *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
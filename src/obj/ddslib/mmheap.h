@@ -0,0 +1,82 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#ifndef mmheap_INCLUDED
+#define mmheap_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+  /* An element records its position in the array, so it can be
+     removed without a search. */
+  typedef struct {
+    size_t index;
+  } mmheap_elem;
+
+  /* Elements on even levels of the tree precede their descendants,
+     and those on odd levels follow them. */
+  typedef struct {
+    void **base;
+    size_t size, cap;
+    void *ctxt;
+    int (*cmp)(void *, const void *, const void *);
+    size_t memb;
+  } mmheap;
+
+#define mmheap_init(R, T, MEMB, OBJ, CMP)       \
+  ((void) ((R)->base = 0,                       \
+           (R)->size = (R)->cap = 0u,           \
+           (R)->memb = offsetof(T, MEMB),       \
+           (R)->ctxt = (OBJ),                   \
+           (R)->cmp = (CMP)))
+
+  /* Release the array, but not the elements. */
+  void mmheap_term(mmheap *);
+
+  /* Ensure space for at least n elements.  Returns 0 on success, or
+     -1 on failure. */
+  int mmheap_reserve(mmheap *, size_t n);
+
+  /* Returns 0 on success, or -1 if the array could not grow. */
+  int mmheap_insert(mmheap *, void *);
+
+  /* Build an empty heap from an array of n elements in linear time.
+     Returns 0 on success, or -1 on failure. */
+  int mmheap_build(mmheap *, void *const *, size_t n);
+
+  void mmheap_remove(mmheap *, void *);
+  void *mmheap_pop_min(mmheap *);
+  void *mmheap_pop_max(mmheap *);
+  void *mmheap_peek_max(const mmheap *);
+#define mmheap_peek_min(R) ((R)->size ? (R)->base[0] : 0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,69 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#ifndef mqueue_INCLUDED
+#define mqueue_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "bheap.h"
+
+  struct mqueue_part;
+
+  /* A concurrent priority queue made of several heaps, each with its
+     own lock.  Elements contain a bheap_elem, and are ordered as in a
+     bheap, but a pop may yield an element a little later in the
+     sequence than the first, in exchange for threads rarely waiting
+     for each other. */
+  typedef struct {
+    struct mqueue_part *part;
+    size_t nparts, stride;
+  } mqueue;
+
+  /* Use a few heaps per thread.  Returns 0 on success, or -1 on
+     failure. */
+  int mqueue_setup(mqueue *, size_t memb, void *ctxt,
+                   int (*cmp)(void *, const void *, const void *),
+                   size_t nparts);
+#define mqueue_init(R, T, MEMB, OBJ, CMP, N)                    \
+  mqueue_setup((R), offsetof(T, MEMB), (OBJ), (CMP), (N))
+
+  /* Release the heaps, but not the elements. */
+  void mqueue_term(mqueue *);
+
+  void mqueue_insert(mqueue *, void *);
+
+  /* Returns NULL only if every heap was found empty. */
+  void *mqueue_pop(mqueue *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
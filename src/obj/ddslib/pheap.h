@@ -0,0 +1,71 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#ifndef pheap_INCLUDED
+#define pheap_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+  /* prev is the left sibling, or the parent of a first child. */
+  typedef struct {
+    void *child, *next, *prev;
+  } pheap_elem;
+
+  typedef struct {
+    void *first;
+    void *ctxt;
+    int (*cmp)(void *, const void *, const void *);
+    size_t memb, size;
+  } pheap;
+
+#define pheap_init(R, T, MEMB, OBJ, CMP)        \
+  ((void) ((R)->first = 0,                      \
+           (R)->memb = offsetof(T, MEMB),       \
+           (R)->ctxt = (OBJ),                   \
+           (R)->cmp = (CMP),                    \
+           (R)->size = 0u))
+
+  void pheap_insert(pheap *, void *);
+  void pheap_remove(pheap *, void *);
+  void *pheap_pop(pheap *);
+#define pheap_peek(R) ((R)->first)
+
+  /* Restore an element's position after it has moved earlier in the
+     sequence. */
+  void pheap_decrease(pheap *, void *);
+
+  /* Move all elements of the second heap into the first, which must
+     have the same order and member. */
+  void pheap_meld(pheap *, pheap *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
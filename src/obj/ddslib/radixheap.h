@@ -0,0 +1,83 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#ifndef radixheap_INCLUDED
+#define radixheap_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dllist.h"
+
+  typedef struct radixheap_elem radixheap_elem;
+  typedef dllist_hdr(radixheap_elem) radixheap_bucket;
+
+  struct radixheap_elem {
+    dllist_elem(radixheap_elem) others;
+    uint64_t key;
+    unsigned bucket;
+  };
+
+  /* Bucket 0 holds keys equal to the last minimum, and bucket i holds
+     keys whose highest bit differing from it is bit i-1. */
+  typedef struct {
+    radixheap_bucket bucket[65];
+    uint64_t last, used;
+    size_t memb, size;
+  } radixheap;
+
+  void radixheap_setup(radixheap *, size_t memb);
+#define radixheap_init(R, T, MEMB) \
+  radixheap_setup((R), offsetof(T, MEMB))
+
+  /* Keys may not be less than the last minimum found, which is
+     initially zero.  Returns 0 on success, or -1 if the key is too
+     small. */
+  int radixheap_insert(radixheap *, void *, uint64_t key);
+  void radixheap_remove(radixheap *, void *);
+
+  /* Give an element a key no greater than its current one, but no
+     less than the last minimum.  Returns 0 on success, or -1 if the
+     key is out of range. */
+  int radixheap_decrease(radixheap *, void *, uint64_t key);
+
+  void *radixheap_peek(radixheap *);
+  void *radixheap_pop(radixheap *);
+#define radixheap_key(R, P) \
+  (((radixheap_elem *) ((char *) (P) + (R)->memb))->key)
+
+  /* Pop up to max elements sharing the least key, returning how
+     many. */
+  size_t radixheap_pop_equal(radixheap *, void **out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
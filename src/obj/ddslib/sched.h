@@ -0,0 +1,99 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#ifndef sched_INCLUDED
+#define sched_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "bheap.h"
+
+  /* An event runs a function with a context at a time in nanoseconds
+     on CLOCK_MONOTONIC.  queued is set while the event waits in a
+     scheduler. */
+  typedef struct {
+    bheap_elem links;
+    uint64_t when;
+    void (*run)(void *ctxt);
+    void *ctxt;
+    int queued;
+  } sched_event;
+
+#define sched_event_init(E, RUN, CTXT)          \
+  ((void) ((E)->run = (RUN),                    \
+           (E)->ctxt = (CTXT),                  \
+           (E)->queued = 0))
+
+  /* A dispatching thread sleeps until the earliest event is due, and
+     then runs every due event in a batch, without holding the lock.
+     busy is set while a batch runs, and batches counts them. */
+  typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake, idle;
+    pthread_t thread;
+    bheap heap;
+    unsigned long batches;
+    int busy, stopping;
+  } sched;
+
+  /* Start the dispatching thread.  Returns 0 on success, or -1 on
+     failure. */
+  int sched_init(sched *);
+
+  /* Stop the dispatching thread, after any batch in progress.  Events
+     still queued are abandoned without running.  Do not call from an
+     event. */
+  void sched_term(sched *);
+
+  /* Get the current time on CLOCK_MONOTONIC in nanoseconds. */
+  uint64_t sched_now(void);
+
+  /* Schedule an event to run at the given time, or as soon as
+     possible if it has passed.  An event already queued is
+     rescheduled.  Events due at the same time run in the order they
+     were scheduled. */
+  void sched_at(sched *, sched_event *, uint64_t when);
+#define sched_after(S, E, DELAY) sched_at((S), (E), sched_now() + (DELAY))
+
+  /* Withdraw a queued event.  Returns 1 if it was queued, and so will
+     not run, or 0 if it was not, in which case it might be running or
+     about to run. */
+  int sched_cancel(sched *, sched_event *);
+
+  /* Wait for any batch in progress to finish, so that a cancelled
+     event is known not to be running.  From within an event, this
+     returns immediately. */
+  void sched_sync(sched *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#ifndef twheel_INCLUDED
+#define twheel_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dllist.h"
+
+  typedef struct twheel_elem twheel_elem;
+  typedef dllist_hdr(twheel_elem) twheel_slot;
+
+  /* slot is null when the timer is not scheduled. */
+  struct twheel_elem {
+    dllist_elem(twheel_elem) others;
+    twheel_slot *slot;
+    uint64_t when;
+  };
+
+  /* Each level has 2^bits slots, each spanning 2^bits times as many
+     ticks as a slot of the level below.  Timers already due wait in a
+     separate list while they are delivered. */
+  typedef struct {
+    twheel_slot *slots, due;
+    uint64_t *occupied;
+    uint64_t now;
+    unsigned bits, levels, words;
+    size_t memb, size;
+  } twheel;
+
+  /* Returns 0 on success, or -1 on failure. */
+  int twheel_setup(twheel *, size_t memb, unsigned bits, unsigned levels,
+                   uint64_t now);
+#define twheel_init(R, T, MEMB, BITS, LEVELS, NOW)                      \
+  twheel_setup((R), offsetof(T, MEMB), (BITS), (LEVELS), (NOW))
+
+  /* Release the slots, but not the timers. */
+  void twheel_term(twheel *);
+
+  /* Schedule a timer to expire at the given tick, rescheduling it if
+     already scheduled.  A tick already passed is treated as the next
+     one. */
+  void twheel_schedule(twheel *, void *, uint64_t when);
+  void twheel_cancel(twheel *, void *);
+#define twheel_scheduled(R, P)                                          \
+  (((twheel_elem *) ((char *) (P) + (R)->memb))->slot != 0)
+#define twheel_now(R) ((R)->now)
+
+  /* Get the earliest tick at which any timer might expire, or
+     UINT64_MAX if none is scheduled. */
+  uint64_t twheel_next(twheel *);
+
+  /* Move time forward to the given tick, passing each timer that
+     expires to a function, and return how many did.  The function
+     may schedule and cancel timers. */
+  size_t twheel_advance(twheel *, uint64_t to,
+                        void (*fire)(void *ctxt, void *), void *ctxt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
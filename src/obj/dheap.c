@@ -0,0 +1,163 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ddslib/dheap.h"
+
+#define get_elem(R,O) ((dheap_elem *) &(R)->memb[(char *) (O)])
+
+/* The children of element i are at d*i+1 to d*i+d.  The key array
+   starts d-1 slots after an aligned boundary, so each group of
+   children starts on one. */
+#define LEAD (dheap_ARITY - 1)
+#define LINE 64
+
+static void place(dheap *r, size_t i, void *p, int64_t k)
+{
+  r->item[i] = p;
+  r->key[i] = k;
+  get_elem(r, p)->index = i;
+}
+
+/* Find the least of n children starting at c.  Full groups are
+   scanned without branches, so the compiler can use conditional moves
+   or vector instructions. */
+static inline size_t min_child(const int64_t *key, size_t c, size_t n)
+{
+  if (n == dheap_ARITY) {
+    const int64_t *g = key + c;
+    size_t a = g[1] < g[0], b = 2 + (g[3] < g[2]);
+#if dheap_ARITY == 8
+    size_t e = 4 + (g[5] < g[4]), f = 6 + (g[7] < g[6]);
+    a = g[b] < g[a] ? b : a;
+    e = g[f] < g[e] ? f : e;
+    return c + (g[e] < g[a] ? e : a);
+#else
+    return c + (g[b] < g[a] ? b : a);
+#endif
+  }
+
+  size_t best = c;
+  for (size_t j = c + 1; j < c + n; j++)
+    if (key[j] < key[best])
+      best = j;
+  return best;
+}
+
+static void sift_up(dheap *r, size_t i, void *p, int64_t k)
+{
+  while (i > 0) {
+    size_t par = (i - 1) / dheap_ARITY;
+    if (k >= r->key[par]) break;
+    place(r, i, r->item[par], r->key[par]);
+    i = par;
+  }
+  place(r, i, p, k);
+}
+
+static void sift_down(dheap *r, size_t i, void *p, int64_t k)
+{
+  size_t c;
+  while ((c = dheap_ARITY * i + 1) < r->size) {
+    size_t n = r->size - c;
+    size_t m = min_child(r->key, c, n < dheap_ARITY ? n : dheap_ARITY);
+    if (r->key[m] >= k) break;
+    place(r, i, r->item[m], r->key[m]);
+    i = m;
+  }
+  place(r, i, p, k);
+}
+
+void dheap_term(dheap *r)
+{
+  free(r->mem);
+  free(r->item);
+  r->mem = 0;
+  r->key = 0;
+  r->item = 0;
+  r->size = r->cap = 0;
+}
+
+int dheap_reserve(dheap *r, size_t n)
+{
+  if (n <= r->cap) return 0;
+
+  void **ni = realloc(r->item, n * sizeof *ni);
+  if (!ni) return -1;
+  r->item = ni;
+
+  void *nm = malloc((n + LEAD) * sizeof r->key[0] + LINE - 1);
+  if (!nm) return -1;
+  int64_t *nk = (int64_t *)
+    (((uintptr_t) nm + LINE - 1) & ~(uintptr_t) (LINE - 1)) + LEAD;
+  if (r->size > 0)
+    memcpy(nk, r->key, r->size * sizeof nk[0]);
+  free(r->mem);
+  r->mem = nm;
+  r->key = nk;
+  r->cap = n;
+  return 0;
+}
+
+int dheap_insert(dheap *r, void *p, int64_t k)
+{
+  if (r->size == r->cap &&
+      dheap_reserve(r, r->cap ? r->cap * 2 : 64) < 0)
+    return -1;
+  sift_up(r, r->size++, p, k);
+  return 0;
+}
+
+void dheap_remove(dheap *r, void *p)
+{
+  size_t i = get_elem(r, p)->index;
+  size_t last = --r->size;
+  if (i == last) return;
+  void *lp = r->item[last];
+  int64_t lk = r->key[last];
+  if (i > 0 && lk < r->key[(i - 1) / dheap_ARITY])
+    sift_up(r, i, lp, lk);
+  else
+    sift_down(r, i, lp, lk);
+}
+
+_Bool dheap_peekkey(const dheap *r, int64_t *key)
+{
+  if (r->size == 0) return 0;
+  *key = r->key[0];
+  return 1;
+}
+
+void *dheap_pop(dheap *r)
+{
+  if (r->size == 0) return 0;
+  void *p = r->item[0];
+  size_t last = --r->size;
+  if (last > 0)
+    sift_down(r, 0, r->item[last], r->key[last]);
+  return p;
+}
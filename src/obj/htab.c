@@ -28,29 +28,77 @@
 #include <string.h>
 #include <assert.h>
 #include <wchar.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include "ddslib/htab.h"
+#include "ddslib/bloom.h"
 
 struct entry;
+struct slab;
+struct frozen;
+struct phdr;
+
+/* A bucket whose generation differs from the table's is empty, so
+   the table can be emptied without visiting every bucket. */
+struct bucket {
+  struct entry *head;
+  unsigned gen;
+};
 
 struct htab_str {
-  struct entry **base;
+  struct bucket *base;
   size_t len;
+  unsigned gen;
   void *ctxt;
   size_t (*hash)(void *, htab_const);
   int (*cmp)(void *, htab_const, htab_const);
+  _Bool (*eq)(void *, htab_const, htab_const);
   htab_obj (*copy_key)(void *ctxt, htab_const);
   htab_obj (*copy_value)(void *ctxt, htab_const);
   void (*release_key)(void *ctxt, htab_obj);
   void (*release_value)(void *ctxt, htab_obj val);
+  size_t count;
+
+  /* An optional filter of the hash codes of all keys, and the number
+     of codes it still holds for keys that have since been removed */
+  bloom filter;
+  unsigned filter_bits;
+  size_t filter_stale;
+
+  /* Entries are allocated from a list of slabs.  Slabs beyond the
+     current one are retained for reuse, and released entries are
+     kept on a spare list.  All but the first slab are freed when
+     removals empty the table. */
+  struct slab *slabs, *cur;
+  struct entry *spare;
+
+  /* Set once the table has been made read-only */
+  struct frozen *frozen;
+
+  /* Set once a snapshot has been taken, when the entries move into a
+     shared trie.  A snapshot is itself a read-only table. */
+  struct phdr *proot;
+  _Bool persistent, readonly;
 };
 
 struct entry {
   struct entry *next;
   htab_obj value;
   htab_obj key;
+  size_t hash;
+};
+
+struct slab {
+  struct slab *next;
+  size_t used, cap;
+  struct entry ent[];
 };
 
+#define SLAB_MIN 16
+#define SLAB_MAX 4096
+
 /* This is a hack to persuade the compiler not to warn about
    dereferencing type-punned pointers.  This is only done in this file
    to convert pointers to htab_obj into pointers to htab_const.  These
@@ -67,6 +115,787 @@ static htab_const *get_const(htab_obj *p)
   return var.c;
 }
 
+/* A frozen table holds one slot per distinct hash code, located by a
+   minimal perfect hash of the code, in the style of CHD.  Codes are
+   assigned to groups, and each group has a displacement, chosen so
+   that the group's codes land on unoccupied slots.  A group with a
+   single code records its slot directly.  Keys sharing a code are
+   chained through a separate array. */
+struct fslot {
+  htab_obj value;
+  htab_obj key;
+  size_t hash;
+
+  /* one more than the index of the next key with the same code, or
+     zero */
+  size_t more;
+};
+
+struct frozen {
+  uint64_t seed;
+  size_t ngroups;
+  uint32_t *disp;
+  size_t len, nextra;
+  struct fslot *slot, *extra;
+};
+
+#define DIRECT ((uint32_t) 1 << 31)
+#define GROUP_SIZE 4
+#define MAX_TRIES 0x100000
+#define MAX_SEEDS 32
+
+static inline uint64_t mix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= UINT64_C(0xff51afd7ed558ccd);
+  h ^= h >> 33;
+  h *= UINT64_C(0xc4ceb9fe1a85ec53);
+  h ^= h >> 33;
+  return h;
+}
+
+/* Map the top half of a word onto [0, n). */
+static inline size_t reduce(uint64_t m, size_t n)
+{
+  return ((m >> 32) * (uint64_t) n) >> 32;
+}
+
+static inline size_t frozen_pos(const struct frozen *f, uint64_t m,
+                                uint32_t d)
+{
+  return reduce(mix(m ^ (d * UINT64_C(0x9e3779b97f4a7c15))), f->len);
+}
+
+static inline _Bool same_key(htab self, htab_const a, htab_const b)
+{
+  if (self->eq)
+    return (*self->eq)(self->ctxt, a, b);
+  return (*self->cmp)(self->ctxt, a, b) == 0;
+}
+
+static struct fslot *frozen_find(htab self, htab_const key, size_t hv)
+{
+  const struct frozen *f = self->frozen;
+  if (f->len == 0) return NULL;
+  uint64_t m = mix(hv ^ f->seed);
+  uint32_t d = f->disp[reduce(m, f->ngroups)];
+  struct fslot *s = &f->slot[d & DIRECT ? d & ~DIRECT : frozen_pos(f, m, d)];
+  if (s->hash != hv) return NULL;
+  while (!same_key(self, key, *get_const(&s->key))) {
+    if (!s->more) return NULL;
+    s = &f->extra[s->more - 1];
+  }
+  return s;
+}
+
+static void release_frozen(htab self)
+{
+  struct frozen *f = self->frozen;
+  if (self->release_key || self->release_value) {
+    for (size_t i = 0; i < f->len + f->nextra; i++) {
+      struct fslot *s = i < f->len ? &f->slot[i] : &f->extra[i - f->len];
+      if (self->release_value)
+        (*self->release_value)(self->ctxt, s->value);
+      if (self->release_key)
+        (*self->release_key)(self->ctxt, s->key);
+    }
+  }
+  free(f->disp);
+  free(f->slot);
+  free(f->extra);
+  free(f);
+  self->frozen = NULL;
+}
+
+/* Read-only access to a bucket; a bucket left over from before the
+   last clear is empty, but is not reset until something is inserted
+   into it. */
+static inline struct entry *peek_head(htab self, size_t i)
+{
+  const struct bucket *b = &self->base[i];
+  return b->gen == self->gen ? b->head : NULL;
+}
+
+static inline struct entry **get_head(htab self, size_t i)
+{
+  struct bucket *b = &self->base[i];
+  if (b->gen != self->gen) {
+    b->gen = self->gen;
+    b->head = NULL;
+  }
+  return &b->head;
+}
+
+static struct entry *new_entry(htab self)
+{
+  struct entry *e = self->spare;
+  if (e) {
+    self->spare = e->next;
+    return e;
+  }
+
+  struct slab *s = self->cur;
+  if (!s || s->used == s->cap) {
+    if (s && s->next) {
+      s = s->next;
+      s->used = 0;
+    } else {
+      size_t cap = s ? s->cap * 2 : SLAB_MIN;
+      if (cap > SLAB_MAX)
+        cap = SLAB_MAX;
+      struct slab *ns = malloc(offsetof(struct slab, ent) +
+                               cap * sizeof ns->ent[0]);
+      if (!ns) return NULL;
+      ns->next = NULL;
+      ns->used = 0;
+      ns->cap = cap;
+      if (s)
+        s->next = ns;
+      else
+        self->slabs = ns;
+      s = ns;
+    }
+    self->cur = s;
+  }
+  return &s->ent[s->used++];
+}
+
+static inline void free_entry(htab self, struct entry *e)
+{
+  e->next = self->spare;
+  self->spare = e;
+}
+
+static void release_slabs(htab self)
+{
+  struct slab *s, *n;
+  for (s = self->slabs; s && (n = s->next, true); s = n)
+    free(s);
+  self->slabs = self->cur = NULL;
+  self->spare = NULL;
+}
+
+/* Once removals have emptied the table, keep only the first slab, so
+   that a table that grew once does not hold its peak memory, while
+   one that repeatedly gains and loses a few entries does not keep
+   allocating. */
+static void trim_slabs(htab self)
+{
+  if (self->count > 0 || !self->slabs || !self->slabs->next) return;
+  struct slab *s, *n;
+  for (s = self->slabs->next; s && (n = s->next, true); s = n)
+    free(s);
+  self->slabs->next = NULL;
+  self->slabs->used = 0;
+  self->cur = self->slabs;
+  self->spare = NULL;
+}
+
+/* Call the release functions on every entry, without removing any. */
+static void release_all(htab self)
+{
+  if (!self->release_key && !self->release_value) return;
+  for (size_t i = 0; i < self->len; i++)
+    for (struct entry *e = peek_head(self, i); e; e = e->next) {
+      if (self->release_value)
+        (*self->release_value)(self->ctxt, e->value);
+      if (self->release_key)
+        (*self->release_key)(self->ctxt, e->key);
+    }
+}
+
+/* Make every bucket appear empty. */
+static void next_gen(htab self)
+{
+  if (++self->gen == 0) {
+    for (size_t i = 0; i < self->len; i++) {
+      self->base[i].head = NULL;
+      self->base[i].gen = 0;
+    }
+  }
+}
+
+static htab_obj make_key(htab self, htab_const key)
+{
+  htab_obj r;
+  if (self->copy_key)
+    return (*self->copy_key)(self->ctxt, key);
+  assert(sizeof key == sizeof r);
+  memcpy(&r, &key, sizeof key);
+  return r;
+}
+
+static htab_obj make_value(htab self, htab_const val)
+{
+  htab_obj r;
+  if (self->copy_value)
+    return (*self->copy_value)(self->ctxt, val);
+  assert(sizeof val == sizeof r);
+  memcpy(&r, &val, sizeof val);
+  return r;
+}
+
+/* Once a snapshot has been taken, a table holds its entries in a
+   persistent hash array-mapped trie, shared between the table and its
+   snapshots.  Each branch consumes five bits of the mixed hash code,
+   and keys with identical codes share a collision node.  Nodes and
+   leaves are reference-counted, and a table only modifies a node in
+   place if no other version can reach it; otherwise, it copies the
+   path to the change.  When a changed leaf is copied, the key is
+   shared through a reference-counted cell. */
+enum { P_LEAF, P_BRANCH, P_COLLIDE };
+
+struct phdr {
+  unsigned refs;
+  unsigned char kind;
+};
+
+struct pkey {
+  unsigned refs;
+  htab_obj key;
+};
+
+struct pleaf {
+  struct phdr hdr;
+  size_t hash;
+  struct pkey *kc;
+  htab_obj value;
+  htab_obj key;
+};
+
+struct pnode {
+  struct phdr hdr;
+  uint32_t bitmap;
+  unsigned len;
+
+  /* the code shared by all leaves of a collision node */
+  size_t hash;
+
+  struct phdr *child[];
+};
+
+#define P_BITS 5
+#define P_MASK ((1u << P_BITS) - 1)
+
+/* Snapshots may be released from other threads. */
+#ifdef __GNUC__
+#define ref_get(P) __atomic_load_n(&(P)->refs, __ATOMIC_ACQUIRE)
+#define ref_inc(P) ((void) __atomic_add_fetch(&(P)->refs, 1, __ATOMIC_RELAXED))
+#define ref_dec(P) __atomic_sub_fetch(&(P)->refs, 1, __ATOMIC_ACQ_REL)
+#else
+#define ref_get(P) ((P)->refs)
+#define ref_inc(P) ((void) ++(P)->refs)
+#define ref_dec(P) (--(P)->refs)
+#endif
+
+static inline unsigned popcount(uint32_t x)
+{
+#ifdef __GNUC__
+  return __builtin_popcount(x);
+#else
+  unsigned r = 0;
+  for ( ; x; x &= x - 1)
+    r++;
+  return r;
+#endif
+}
+
+static inline unsigned p_index(uint64_t m, unsigned shift)
+{
+  return (m >> shift) & P_MASK;
+}
+
+static struct pnode *new_pnode(unsigned char kind, unsigned len)
+{
+  struct pnode *n =
+    malloc(offsetof(struct pnode, child) + len * sizeof n->child[0]);
+  if (!n) return NULL;
+  n->hdr.refs = 1;
+  n->hdr.kind = kind;
+  n->bitmap = 0;
+  n->len = len;
+  n->hash = 0;
+  return n;
+}
+
+static void free_pleaf(htab self, struct pleaf *l, _Bool value)
+{
+  if (value && self->release_value)
+    (*self->release_value)(self->ctxt, l->value);
+  if (l->kc) {
+    if (ref_dec(l->kc) == 0) {
+      if (self->release_key)
+        (*self->release_key)(self->ctxt, l->kc->key);
+      free(l->kc);
+    }
+  } else if (self->release_key) {
+    (*self->release_key)(self->ctxt, l->key);
+  }
+  free(l);
+}
+
+static void unref(htab self, struct phdr *h)
+{
+  if (ref_dec(h) != 0) return;
+  if (h->kind == P_LEAF) {
+    free_pleaf(self, (struct pleaf *) h, true);
+    return;
+  }
+  struct pnode *n = (struct pnode *) h;
+  for (unsigned i = 0; i < n->len; i++)
+    unref(self, n->child[i]);
+  free(n);
+}
+
+/* Free a trie built from a chained table's entries, without releasing
+   anything they own. */
+static void free_shallow(struct phdr *h)
+{
+  if (!h) return;
+  if (h->kind != P_LEAF) {
+    struct pnode *n = (struct pnode *) h;
+    for (unsigned i = 0; i < n->len; i++)
+      free_shallow(n->child[i]);
+  }
+  free(h);
+}
+
+/* Get a node that can be modified without affecting other versions,
+   copying it if necessary. */
+static struct pnode *unique_pnode(struct pnode *n)
+{
+  if (ref_get(&n->hdr) == 1) return n;
+  struct pnode *r = new_pnode(n->hdr.kind, n->len);
+  if (!r) return NULL;
+  r->bitmap = n->bitmap;
+  r->hash = n->hash;
+  for (unsigned i = 0; i < n->len; i++) {
+    r->child[i] = n->child[i];
+    ref_inc(r->child[i]);
+  }
+  return r;
+}
+
+/* Replace a node with a copy that has a gap at the given index,
+   returning NULL on failure. */
+static struct pnode *grow_pnode(htab self, struct pnode *n, unsigned idx)
+{
+  struct pnode *r = new_pnode(n->hdr.kind, n->len + 1);
+  if (!r) return NULL;
+  r->bitmap = n->bitmap;
+  r->hash = n->hash;
+  memcpy(&r->child[0], &n->child[0], idx * sizeof n->child[0]);
+  memcpy(&r->child[idx + 1], &n->child[idx],
+         (n->len - idx) * sizeof n->child[0]);
+  r->child[idx] = NULL;
+  if (ref_get(&n->hdr) == 1) {
+    free(n);
+  } else {
+    for (unsigned i = 0; i < r->len; i++)
+      if (i != idx)
+        ref_inc(r->child[i]);
+    unref(self, &n->hdr);
+  }
+  return r;
+}
+
+static inline uint64_t p_code(const struct phdr *h)
+{
+  if (h->kind == P_LEAF)
+    return mix(((const struct pleaf *) h)->hash);
+  return mix(((const struct pnode *) h)->hash);
+}
+
+/* Make a subtree holding a and b, whose codes differ, below the given
+   shift. */
+static struct phdr *p_split(struct phdr *a, struct phdr *b, unsigned shift)
+{
+  uint64_t ma = p_code(a), mb = p_code(b);
+  unsigned depth = 0;
+  while (p_index(ma, shift + depth * P_BITS) ==
+         p_index(mb, shift + depth * P_BITS))
+    depth++;
+
+  struct pnode *nodes[64 / P_BITS + 1];
+  for (unsigned i = 0; i <= depth; i++) {
+    nodes[i] = new_pnode(P_BRANCH, i < depth ? 1 : 2);
+    if (!nodes[i]) {
+      while (i > 0)
+        free(nodes[--i]);
+      return NULL;
+    }
+  }
+
+  for (unsigned i = 0; i < depth; i++) {
+    nodes[i]->bitmap = (uint32_t) 1 << p_index(ma, shift + i * P_BITS);
+    nodes[i]->child[0] = &nodes[i + 1]->hdr;
+  }
+  unsigned s = shift + depth * P_BITS;
+  unsigned ia = p_index(ma, s), ib = p_index(mb, s);
+  nodes[depth]->bitmap = ((uint32_t) 1 << ia) | ((uint32_t) 1 << ib);
+  nodes[depth]->child[ia > ib] = a;
+  nodes[depth]->child[ia < ib] = b;
+  return &nodes[0]->hdr;
+}
+
+struct pargs {
+  htab self;
+  htab_const key, val;
+  size_t hash;
+  uint64_t m;
+  htab_obj *old;
+
+  /* a prepared leaf to be inserted, if not NULL */
+  struct pleaf *leaf;
+};
+
+static struct pleaf *new_pleaf(struct pargs *a)
+{
+  if (a->leaf) return a->leaf;
+  struct pleaf *l = malloc(sizeof *l);
+  if (!l) return NULL;
+  l->hdr.refs = 1;
+  l->hdr.kind = P_LEAF;
+  l->hash = a->hash;
+  l->kc = NULL;
+  l->key = make_key(a->self, a->key);
+  l->value = make_value(a->self, a->val);
+  return l;
+}
+
+static void discard_pleaf(struct pargs *a, struct pleaf *l)
+{
+  if (l == a->leaf)
+    return;
+  free_pleaf(a->self, l, true);
+}
+
+/* Yield the value of a leaf being replaced or removed.  If other
+   versions still have it, the caller gets a copy, if possible. */
+static void yield_value(htab self, struct pleaf *l, htab_obj *old,
+                        _Bool shared)
+{
+  if (!shared || !self->copy_value)
+    *old = l->value;
+  else
+    *old = (*self->copy_value)(self->ctxt, *get_const(&l->value));
+}
+
+/* Get the value replacing an existing one.  A prepared leaf gives up
+   its value, and its key is surplus. */
+static htab_obj replacement(struct pargs *a)
+{
+  htab self = a->self;
+  struct pleaf *l = a->leaf;
+  if (!l) return make_value(self, a->val);
+  htab_obj v = l->value;
+  if (self->release_key)
+    (*self->release_key)(self->ctxt, l->key);
+  free(l);
+  a->leaf = NULL;
+  return v;
+}
+
+static htab_rplc p_replace(struct pargs *a, struct phdr **slot,
+                           struct pleaf *l)
+{
+  htab self = a->self;
+  if (ref_get(&l->hdr) == 1) {
+    if (a->old)
+      *a->old = l->value;
+    else if (self->release_value)
+      (*self->release_value)(self->ctxt, l->value);
+    l->value = replacement(a);
+    return htab_REPLACED;
+  }
+
+  struct pleaf *nl = malloc(sizeof *nl);
+  struct pkey *kc = l->kc ? l->kc : malloc(sizeof *kc);
+  if (!nl || !kc) {
+    free(nl);
+    if (kc != l->kc)
+      free(kc);
+    return htab_ERROR;
+  }
+  if (kc == l->kc) {
+    ref_inc(kc);
+  } else {
+    kc->refs = 2;
+    kc->key = l->key;
+    l->kc = kc;
+  }
+  nl->hdr.refs = 1;
+  nl->hdr.kind = P_LEAF;
+  nl->hash = l->hash;
+  nl->kc = kc;
+  nl->key = l->key;
+  nl->value = replacement(a);
+  if (a->old)
+    yield_value(self, l, a->old, true);
+  *slot = &nl->hdr;
+  unref(self, &l->hdr);
+  return htab_REPLACED;
+}
+
+/* Add a new leaf beside an existing leaf or collision node whose code
+   is different, or beside a leaf with the same code. */
+static htab_rplc p_beside(struct pargs *a, struct phdr **slot,
+                          size_t hash, unsigned shift)
+{
+  struct pleaf *l = new_pleaf(a);
+  if (!l) return htab_ERROR;
+  struct phdr *r;
+  if (hash == a->hash) {
+    struct pnode *c = new_pnode(P_COLLIDE, 2);
+    if (c) {
+      c->hash = hash;
+      c->child[0] = *slot;
+      c->child[1] = &l->hdr;
+    }
+    r = &c->hdr;
+  } else {
+    r = p_split(*slot, &l->hdr, shift);
+  }
+  if (!r) {
+    discard_pleaf(a, l);
+    return htab_ERROR;
+  }
+  *slot = r;
+  return htab_OKAY;
+}
+
+/* Insert or replace within the subtree at *slot, which belongs to a
+   node that no other version can reach. */
+static htab_rplc p_insert(struct pargs *a, struct phdr **slot,
+                          unsigned shift)
+{
+  htab self = a->self;
+  struct phdr *h = *slot;
+  if (!h) {
+    struct pleaf *l = new_pleaf(a);
+    if (!l) return htab_ERROR;
+    *slot = &l->hdr;
+    return htab_OKAY;
+  }
+
+  if (h->kind == P_LEAF) {
+    struct pleaf *l = (struct pleaf *) h;
+    if (l->hash == a->hash && same_key(self, a->key, *get_const(&l->key)))
+      return p_replace(a, slot, l);
+    return p_beside(a, slot, l->hash, shift);
+  }
+
+  struct pnode *n = (struct pnode *) h;
+  unsigned idx;
+  if (h->kind == P_COLLIDE) {
+    if (n->hash != a->hash)
+      return p_beside(a, slot, n->hash, shift);
+    for (idx = 0; idx < n->len; idx++) {
+      struct pleaf *l = (struct pleaf *) n->child[idx];
+      if (same_key(self, a->key, *get_const(&l->key)))
+        break;
+    }
+    if (idx == n->len) {
+      struct pleaf *l = new_pleaf(a);
+      if (!l) return htab_ERROR;
+      struct pnode *r = grow_pnode(self, n, idx);
+      if (!r) {
+        discard_pleaf(a, l);
+        return htab_ERROR;
+      }
+      r->child[idx] = &l->hdr;
+      *slot = &r->hdr;
+      return htab_OKAY;
+    }
+  } else {
+    uint32_t bit = (uint32_t) 1 << p_index(a->m, shift);
+    idx = popcount(n->bitmap & (bit - 1));
+    if (!(n->bitmap & bit)) {
+      struct pleaf *l = new_pleaf(a);
+      if (!l) return htab_ERROR;
+      struct pnode *r = grow_pnode(self, n, idx);
+      if (!r) {
+        discard_pleaf(a, l);
+        return htab_ERROR;
+      }
+      r->bitmap |= bit;
+      r->child[idx] = &l->hdr;
+      *slot = &r->hdr;
+      return htab_OKAY;
+    }
+  }
+
+  struct pnode *r = unique_pnode(n);
+  if (!r) return htab_ERROR;
+  htab_rplc rc = h->kind == P_COLLIDE ?
+    p_replace(a, &r->child[idx], (struct pleaf *) r->child[idx]) :
+    p_insert(a, &r->child[idx], shift + P_BITS);
+  if (r != n) {
+    if (rc == htab_ERROR) {
+      unref(self, &r->hdr);
+    } else {
+      *slot = &r->hdr;
+      unref(self, h);
+    }
+  }
+  return rc;
+}
+
+/* Remove from the subtree at *slot, which belongs to a node that no
+   other version can reach.  Returns 1 if removed, 0 if not found, or
+   -1 on failure. */
+static int p_remove(struct pargs *a, struct phdr **slot, unsigned shift)
+{
+  htab self = a->self;
+  struct phdr *h = *slot;
+  if (!h) return 0;
+
+  if (h->kind == P_LEAF) {
+    struct pleaf *l = (struct pleaf *) h;
+    if (l->hash != a->hash || !same_key(self, a->key, *get_const(&l->key)))
+      return 0;
+    *slot = NULL;
+    _Bool shared = ref_get(h) != 1;
+    if (!a->old)
+      unref(self, h);
+    else if (shared) {
+      yield_value(self, l, a->old, true);
+      unref(self, h);
+    } else {
+      *a->old = l->value;
+      free_pleaf(self, l, false);
+    }
+    return 1;
+  }
+
+  struct pnode *n = (struct pnode *) h;
+  unsigned idx;
+  uint32_t bit = 0;
+  if (h->kind == P_COLLIDE) {
+    if (n->hash != a->hash) return 0;
+    for (idx = 0; idx < n->len; idx++) {
+      struct pleaf *l = (struct pleaf *) n->child[idx];
+      if (same_key(self, a->key, *get_const(&l->key)))
+        break;
+    }
+    if (idx == n->len) return 0;
+  } else {
+    bit = (uint32_t) 1 << p_index(a->m, shift);
+    if (!(n->bitmap & bit)) return 0;
+    idx = popcount(n->bitmap & (bit - 1));
+  }
+
+  struct pnode *r = unique_pnode(n);
+  if (!r) return -1;
+  int rc = p_remove(a, &r->child[idx], shift + P_BITS);
+  if (rc <= 0) {
+    if (r != n)
+      unref(self, &r->hdr);
+    return rc;
+  }
+
+  /* Close the gap, and replace a node left with only a leaf or
+     collision node by that child. */
+  if (!r->child[idx]) {
+    memmove(&r->child[idx], &r->child[idx + 1],
+            (r->len - idx - 1) * sizeof r->child[0]);
+    r->len--;
+    r->bitmap &= ~bit;
+  }
+  if (r->len == 0) {
+    *slot = NULL;
+    free(r);
+  } else if (r->len == 1 && r->child[0]->kind != P_BRANCH) {
+    *slot = r->child[0];
+    free(r);
+  } else {
+    *slot = &r->hdr;
+  }
+  if (r != n)
+    unref(self, h);
+  return 1;
+}
+
+static struct pleaf *p_find(htab self, htab_const key, size_t hv)
+{
+  uint64_t m = mix(hv);
+  struct phdr *h = self->proot;
+  for (unsigned shift = 0; h; shift += P_BITS) {
+    if (h->kind == P_LEAF) {
+      struct pleaf *l = (struct pleaf *) h;
+      if (l->hash == hv && same_key(self, key, *get_const(&l->key)))
+        return l;
+      return NULL;
+    }
+    struct pnode *n = (struct pnode *) h;
+    if (h->kind == P_COLLIDE) {
+      if (n->hash != hv) return NULL;
+      for (unsigned i = 0; i < n->len; i++) {
+        struct pleaf *l = (struct pleaf *) n->child[i];
+        if (same_key(self, key, *get_const(&l->key)))
+          return l;
+      }
+      return NULL;
+    }
+    uint32_t bit = (uint32_t) 1 << p_index(m, shift);
+    if (!(n->bitmap & bit)) return NULL;
+    h = n->child[popcount(n->bitmap & (bit - 1))];
+  }
+  return NULL;
+}
+
+/* Call a function on every leaf until it returns non-zero. */
+static int p_walk(struct phdr *h,
+                  int (*fn)(void *, struct pleaf *), void *ctxt)
+{
+  if (!h) return 0;
+  if (h->kind == P_LEAF)
+    return (*fn)(ctxt, (struct pleaf *) h);
+  struct pnode *n = (struct pnode *) h;
+  for (unsigned i = 0; i < n->len; i++)
+    if (p_walk(n->child[i], fn, ctxt))
+      return 1;
+  return 0;
+}
+
+/* Move all entries of a chained table into a trie. */
+static _Bool make_persistent(htab self)
+{
+  struct phdr *root = NULL;
+  for (size_t i = 0; i < self->len; i++)
+    for (struct entry *e = peek_head(self, i); e; e = e->next) {
+      struct pleaf *l = malloc(sizeof *l);
+      if (!l) {
+        free_shallow(root);
+        return false;
+      }
+      l->hdr.refs = 1;
+      l->hdr.kind = P_LEAF;
+      l->hash = e->hash;
+      l->kc = NULL;
+      l->key = e->key;
+      l->value = e->value;
+
+      struct pargs a = {
+        .self = self, .hash = e->hash, .m = mix(e->hash),
+        .key = *get_const(&e->key), .leaf = l,
+      };
+      if (p_insert(&a, &root, 0) == htab_ERROR) {
+        free(l);
+        free_shallow(root);
+        return false;
+      }
+    }
+
+  release_slabs(self);
+  free(self->base);
+  self->base = NULL;
+  self->len = 0;
+  self->proot = root;
+  self->persistent = true;
+  return true;
+}
+
 htab htab_open(size_t n, void *ctxt,
                size_t (*hash)(void *, htab_const),
                int (*cmp)(void *, htab_const, htab_const),
@@ -90,12 +919,25 @@ htab htab_open(size_t n, void *ctxt,
   self->ctxt = ctxt;
   self->hash = hash;
   self->cmp = cmp;
+  self->eq = NULL;
   self->copy_key = copy_key;
   self->copy_value = copy_value;
   self->release_key = release_key;
   self->release_value = release_value;
-  for (i = 0; i < n; i++)
-    self->base[i] = NULL;
+  self->count = 0;
+  self->filter = NULL;
+  self->filter_bits = 0;
+  self->filter_stale = 0;
+  self->slabs = self->cur = NULL;
+  self->spare = NULL;
+  self->frozen = NULL;
+  self->proot = NULL;
+  self->persistent = self->readonly = false;
+  self->gen = 0;
+  for (i = 0; i < n; i++) {
+    self->base[i].head = NULL;
+    self->base[i].gen = 0;
+  }
 
   return self;
 }
@@ -103,48 +945,71 @@ htab htab_open(size_t n, void *ctxt,
 void htab_close(htab self)
 {
   if (!self) return;
-  size_t i;
-  for (i = 0; i < self->len; i++) {
-    struct entry *n, *e;
-    for (e = self->base[i]; e && (n = e->next, true); e = n) {
-      if (self->release_value)
-        (*self->release_value)(self->ctxt, e->value);
-      if (self->release_key)
-        (*self->release_key)(self->ctxt, e->key);
-      free(e);
-    }
-    self->base[i] = NULL;
-  }
+  if (self->frozen)
+    release_frozen(self);
+  if (self->proot)
+    unref(self, self->proot);
+  release_all(self);
+  release_slabs(self);
   free(self->base);
   self->base = NULL;
+  bloom_close(self->filter);
   free(self);
 }
 
-static htab_apprc clear_item(void *vp, htab_const key, htab_obj val)
+static void clear(htab self)
 {
-  return htab_REMOVE;
+  if (self->persistent) {
+    if (self->proot)
+      unref(self, self->proot);
+    self->proot = NULL;
+  }
+  release_all(self);
+  next_gen(self);
+  self->count = 0;
+  if (self->filter) {
+    bloom_clear(self->filter);
+    self->filter_stale = 0;
+  }
 }
 
 void htab_clear(htab self)
 {
-  htab_apply(self, NULL, &clear_item);
+  if (self->frozen || self->readonly) return;
+  clear(self);
+  release_slabs(self);
+}
+
+void htab_clear_keep_capacity(htab self)
+{
+  if (self->frozen || self->readonly) return;
+  clear(self);
+  self->spare = NULL;
+  self->cur = self->slabs;
+  if (self->cur)
+    self->cur->used = 0;
 }
 
+/* FNV-1a, so that keys differing only in the order of their
+   characters do not collide */
+#define FNV_BASIS ((size_t) 2166136261U)
+#define FNV_PRIME ((size_t) 16777619U)
+
 size_t htab_hash_str(void *ctxt, htab_const key)
 {
-  size_t r = 0;
-  const char *s = key.pointer;
+  size_t r = FNV_BASIS;
+  const unsigned char *s = key.pointer;
   while (*s)
-    r += *s++;
+    r = (r ^ *s++) * FNV_PRIME;
   return r;
 }
 
 size_t htab_hash_wcs(void *ctxt, htab_const key)
 {
-  size_t r = 0;
+  size_t r = FNV_BASIS;
   const wchar_t *s = key.pointer;
   while (*s)
-    r += *s++;
+    r = (r ^ (size_t) *s++) * FNV_PRIME;
   return r;
 }
 
@@ -158,6 +1023,11 @@ int htab_cmp_wcs(void *ctxt, htab_const a, htab_const b)
   return wcscmp(a.pointer, b.pointer);
 }
 
+void htab_seteq(htab self, _Bool (*eq)(void *, htab_const, htab_const))
+{
+  self->eq = eq;
+}
+
 htab_obj htab_copy_str(void *ctxt, htab_const in)
 {
   htab_obj out;
@@ -191,74 +1061,213 @@ void htab_release_free(void *ctxt, htab_obj key)
   free(key.pointer);
 }
 
-static inline struct entry **find_ptr(htab self, htab_const key)
+static int filter_leaf(void *ctxt, struct pleaf *l)
 {
-  struct entry **res;
-  size_t hv = (*self->hash)(self->ctxt, key);
-  hv %= self->len;
-  res = &self->base[hv];
-  while (*res && (*self->cmp)(self->ctxt, key, *get_const(&(*res)->key)))
-    res = &(*res)->next;
-  return res;
+  bloom_add(ctxt, l->hash);
+  return 0;
 }
 
-_Bool htab_get(htab self, htab_const key, htab_obj *old)
+/* Replace the filter with one sized for the current contents.  On
+   failure, the old filter is kept, as it still holds every extant
+   key. */
+static void rebuild_filter(htab self)
 {
-  struct entry **pos = find_ptr(self, key);
-  if (!pos || !*pos) return false;
-  *old = (*pos)->value;
-  return true;
+  size_t n = self->count * 2;
+  if (n < self->len)
+    n = self->len;
+  bloom nf = bloom_open(n, self->filter_bits);
+  if (!nf) return;
+  if (self->frozen) {
+    const struct frozen *f = self->frozen;
+    for (size_t i = 0; i < f->len; i++)
+      bloom_add(nf, f->slot[i].hash);
+  }
+  p_walk(self->proot, &filter_leaf, nf);
+  for (size_t i = 0; i < self->len; i++)
+    for (struct entry *e = peek_head(self, i); e; e = e->next)
+      bloom_add(nf, e->hash);
+  bloom_close(self->filter);
+  self->filter = nf;
+  self->filter_stale = 0;
 }
 
-_Bool htab_pop(htab self, htab_const key, htab_obj *old)
+/* Rebuild the filter once it is overfull, or once more of its codes
+   are from removed keys than from current ones. */
+static void check_filter(htab self)
 {
-  struct entry *e, **pos = find_ptr(self, key);
-  if (!pos || !*pos) return false;
-  if (old) {
-    *old = (*pos)->value;
-  } else if (self->release_value) {
-    (*self->release_value)(self->ctxt, (*pos)->value);
-  }
-  e = *pos;
-  *pos = e->next;
-  if (self->release_key)
-    (*self->release_key)(self->ctxt, e->key);
-  return true;
+  if (!self->filter) return;
+  if (self->count > bloom_capacity(self->filter) ||
+      self->filter_stale > self->count)
+    rebuild_filter(self);
 }
 
-htab_rplc htab_rpl(htab self, htab_const key, htab_obj *old, htab_const val)
+_Bool htab_bloom(htab self, unsigned bits)
 {
-  struct entry **pos = find_ptr(self, key);
-  _Bool r = *pos;
-  if (r) {
-    if (old)
-      *old = (*pos)->value;
-    else if (self->release_value)
+  if (self->readonly) return false;
+  if (bits == 0) {
+    bloom_close(self->filter);
+    self->filter = NULL;
+    return true;
+  }
+
+  bloom old = self->filter;
+  self->filter = NULL;
+  self->filter_bits = bits;
+  rebuild_filter(self);
+  if (!self->filter) {
+    self->filter = old;
+    return false;
+  }
+  bloom_close(old);
+  return true;
+}
+
+static inline struct entry *find_entry(htab self, htab_const key, size_t hv)
+{
+  struct entry *e = peek_head(self, hv % self->len);
+  while (e && (e->hash != hv || !same_key(self, key, *get_const(&e->key))))
+    e = e->next;
+  return e;
+}
+
+static inline struct entry **find_ptr(htab self, htab_const key, size_t hv)
+{
+  struct entry **res = get_head(self, hv % self->len);
+  while (*res && ((*res)->hash != hv ||
+                  !same_key(self, key, *get_const(&(*res)->key))))
+    res = &(*res)->next;
+  return res;
+}
+
+size_t htab_hash_key(htab self, htab_const key)
+{
+  return (*self->hash)(self->ctxt, key);
+}
+
+_Bool htab_get(htab self, htab_const key, htab_obj *old)
+{
+  return htab_get_hashed(self, key, htab_hash_key(self, key), old);
+}
+
+_Bool htab_get_hashed(htab self, htab_const key, size_t hv, htab_obj *old)
+{
+  if (self->filter && !bloom_tst(self->filter, hv))
+    return false;
+  if (self->frozen) {
+    struct fslot *s = frozen_find(self, key, hv);
+    if (!s) return false;
+    if (old)
+      *old = s->value;
+    return true;
+  }
+  if (self->persistent) {
+    struct pleaf *l = p_find(self, key, hv);
+    if (!l) return false;
+    if (old)
+      *old = l->value;
+    return true;
+  }
+  struct entry *e = find_entry(self, key, hv);
+  if (!e) return false;
+  if (old)
+    *old = e->value;
+  return true;
+}
+
+htab_popc htab_pop(htab self, htab_const key, htab_obj *old)
+{
+  return htab_pop_hashed(self, key, htab_hash_key(self, key), old);
+}
+
+htab_popc htab_pop_hashed(htab self, htab_const key, size_t hv,
+                          htab_obj *old)
+{
+  if (self->frozen || self->readonly) return htab_FAILED;
+  if (self->filter && !bloom_tst(self->filter, hv))
+    return htab_ABSENT;
+  if (self->persistent) {
+    struct pargs a = {
+      .self = self, .key = key, .hash = hv, .m = mix(hv), .old = old,
+    };
+    int rc = p_remove(&a, &self->proot, 0);
+    if (rc < 0) return htab_FAILED;
+    if (rc == 0) return htab_ABSENT;
+  } else {
+    /* Check first, so that a miss does not reset a stale bucket. */
+    if (!find_entry(self, key, hv)) return htab_ABSENT;
+    struct entry *e, **pos = find_ptr(self, key, hv);
+    if (old) {
+      *old = (*pos)->value;
+    } else if (self->release_value) {
       (*self->release_value)(self->ctxt, (*pos)->value);
+    }
+    e = *pos;
+    *pos = e->next;
+    if (self->release_key)
+      (*self->release_key)(self->ctxt, e->key);
+    free_entry(self, e);
+  }
+  self->count--;
+  trim_slabs(self);
+  self->filter_stale++;
+  check_filter(self);
+  return htab_REMOVED;
+}
+
+htab_rplc htab_rpl(htab self, htab_const key, htab_obj *old, htab_const val)
+{
+  return htab_rpl_hashed(self, key, htab_hash_key(self, key), old, val);
+}
+
+htab_rplc htab_rpl_hashed(htab self, htab_const key, size_t hv,
+                          htab_obj *old, htab_const val)
+{
+  if (self->frozen || self->readonly) return htab_ERROR;
+  _Bool r;
+  if (self->persistent) {
+    struct pargs a = {
+      .self = self, .key = key, .val = val, .hash = hv, .m = mix(hv),
+      .old = old,
+    };
+    htab_rplc rc = p_insert(&a, &self->proot, 0);
+    if (rc == htab_ERROR) return rc;
+    r = rc == htab_REPLACED;
   } else {
-    *pos = malloc(sizeof **pos);
-    if (!*pos)
-      return htab_ERROR;
-    (*pos)->next = NULL;
-    if (self->copy_key)
-      (*pos)->key = (*self->copy_key)(self->ctxt, key);
-    else {
-      assert(sizeof key == sizeof (*pos)->key);
-      memcpy(&(*pos)->key, &key, sizeof key);
+    struct entry **pos = find_ptr(self, key, hv);
+    r = *pos;
+    if (r) {
+      if (old)
+        *old = (*pos)->value;
+      else if (self->release_value)
+        (*self->release_value)(self->ctxt, (*pos)->value);
+    } else {
+      *pos = new_entry(self);
+      if (!*pos)
+        return htab_ERROR;
+      (*pos)->next = NULL;
+      (*pos)->hash = hv;
+      (*pos)->key = make_key(self, key);
     }
+    (*pos)->value = make_value(self, val);
   }
-  if (self->copy_value)
-    (*pos)->value = (*self->copy_value)(self->ctxt, val);
-  else {
-    assert(sizeof val == sizeof (*pos)->value);
-    memcpy(&(*pos)->value, &val, sizeof val);
+  if (!r) {
+    self->count++;
+    if (self->filter) {
+      bloom_add(self->filter, hv);
+      check_filter(self);
+    }
   }
   return r ? htab_REPLACED : htab_OKAY;
 }
 
 _Bool htab_put(htab self, htab_const key, htab_const val)
 {
-  switch (htab_rpl(self, key, NULL, val)) {
+  return htab_put_hashed(self, key, htab_hash_key(self, key), val);
+}
+
+_Bool htab_put_hashed(htab self, htab_const key, size_t hv, htab_const val)
+{
+  switch (htab_rpl_hashed(self, key, hv, NULL, val)) {
   case htab_ERROR:
     return false;
   default:
@@ -266,11 +1275,90 @@ _Bool htab_put(htab self, htab_const key, htab_const val)
   }
 }
 
-void htab_apply(htab self, void *ctxt,
-                htab_apprc (*op)(void *, htab_const, htab_obj))
+_Bool htab_reserve(htab self, size_t n)
 {
+  if (self->readonly) return false;
+  if (self->frozen || self->persistent || n <= self->len) return true;
+
+  struct bucket *nb = malloc(n * sizeof nb[0]);
+  if (!nb) return false;
+  for (size_t i = 0; i < n; i++) {
+    nb[i].head = NULL;
+    nb[i].gen = self->gen;
+  }
   for (size_t i = 0; i < self->len; i++) {
-    struct entry *n, *e, **eh = &self->base[i];
+    struct entry *next, *e;
+    for (e = peek_head(self, i); e && (next = e->next, true); e = next) {
+      struct bucket *b = &nb[e->hash % n];
+      e->next = b->head;
+      b->head = e;
+    }
+  }
+  free(self->base);
+  self->base = nb;
+  self->len = n;
+  return true;
+}
+
+/* Insert a key and value that the table takes ownership of, as if
+   they had been produced by its copy functions.  On failure, they
+   still belong to the caller. */
+static _Bool put_owned(htab self, size_t hv, htab_obj key, htab_obj val)
+{
+  htab_const ck = *get_const(&key);
+  if (self->persistent) {
+    struct pleaf *l = malloc(sizeof *l);
+    if (!l) return false;
+    l->hdr.refs = 1;
+    l->hdr.kind = P_LEAF;
+    l->hash = hv;
+    l->kc = NULL;
+    l->key = key;
+    l->value = val;
+
+    /* A replacement takes the value from the leaf and releases the
+       key, leaving the table as it was if it fails. */
+    struct pargs a = {
+      .self = self, .key = ck, .hash = hv, .m = mix(hv), .leaf = l,
+    };
+    htab_rplc rc = p_insert(&a, &self->proot, 0);
+    if (rc == htab_ERROR) {
+      free(l);
+      return false;
+    }
+    if (rc == htab_REPLACED)
+      return true;
+  } else {
+    struct entry **pos = find_ptr(self, ck, hv);
+    if (*pos) {
+      if (self->release_value)
+        (*self->release_value)(self->ctxt, (*pos)->value);
+      if (self->release_key)
+        (*self->release_key)(self->ctxt, key);
+      (*pos)->value = val;
+      return true;
+    }
+    struct entry *e = *pos = new_entry(self);
+    if (!e) return false;
+    e->next = NULL;
+    e->hash = hv;
+    e->key = key;
+    e->value = val;
+  }
+  self->count++;
+  if (self->filter) {
+    bloom_add(self->filter, hv);
+    check_filter(self);
+  }
+  return true;
+}
+
+static void apply(htab self, void *ctxt,
+                  htab_apprc (*op)(void *, htab_const, htab_obj))
+{
+  for (size_t i = 0; i < self->len; i++) {
+    if (self->base[i].gen != self->gen) continue;
+    struct entry *n, *e, **eh = &self->base[i].head;
     for (e = *eh; e && (n = e->next, true); e = n) {
       htab_apprc rc = (*op)(ctxt, *get_const(&e->key), e->value);
       if (rc & htab_REMOVE) {
@@ -278,8 +1366,10 @@ void htab_apply(htab self, void *ctxt,
           (*self->release_value)(self->ctxt, e->value);
         if (self->release_key)
           (*self->release_key)(self->ctxt, e->key);
-        free(e);
+        free_entry(self, e);
         *eh = n;
+        self->count--;
+        self->filter_stale++;
       } else
         eh = &e->next;
       if (rc & htab_STOP)
@@ -288,6 +1378,644 @@ void htab_apply(htab self, void *ctxt,
   }
 }
 
+static void apply_frozen(htab self, void *ctxt,
+                         htab_apprc (*op)(void *, htab_const, htab_obj))
+{
+  struct frozen *f = self->frozen;
+  for (size_t i = 0; i < f->len + f->nextra; i++) {
+    struct fslot *s = i < f->len ? &f->slot[i] : &f->extra[i - f->len];
+    if ((*op)(ctxt, *get_const(&s->key), s->value) & htab_STOP)
+      return;
+  }
+}
+
+struct papply {
+  htab self;
+  void *ctxt;
+  htab_apprc (*op)(void *, htab_const, htab_obj);
+};
+
+static int apply_leaf(void *ctxt, struct pleaf *l)
+{
+  struct papply *pa = ctxt;
+  htab self = pa->self;
+  htab_const key = *get_const(&l->key);
+  htab_apprc rc = (*pa->op)(pa->ctxt, key, l->value);
+  if ((rc & htab_REMOVE) && !self->readonly) {
+    struct pargs a = {
+      .self = self, .key = key, .hash = l->hash, .m = mix(l->hash),
+    };
+    if (p_remove(&a, &self->proot, 0) > 0) {
+      self->count--;
+      self->filter_stale++;
+    }
+  }
+  return rc & htab_STOP;
+}
+
+/* Walk a version of the trie that is unaffected by removals. */
+static void apply_persistent(htab self, void *ctxt,
+                             htab_apprc (*op)(void *, htab_const, htab_obj))
+{
+  struct phdr *root = self->proot;
+  if (!root) return;
+  ref_inc(root);
+  struct papply pa = { .self = self, .ctxt = ctxt, .op = op };
+  p_walk(root, &apply_leaf, &pa);
+  unref(self, root);
+}
+
+void htab_apply(htab self, void *ctxt,
+                htab_apprc (*op)(void *, htab_const, htab_obj))
+{
+  if (self->frozen) {
+    apply_frozen(self, ctxt, op);
+    return;
+  }
+  if (self->persistent)
+    apply_persistent(self, ctxt, op);
+  else
+    apply(self, ctxt, op);
+  trim_slabs(self);
+  check_filter(self);
+}
+
+struct code {
+  uint64_t m;
+  size_t hash, group, more;
+  struct entry *e;
+};
+
+static int cmp_code(const void *av, const void *bv)
+{
+  const struct code *a = av, *b = bv;
+  if (a->hash < b->hash) return -1;
+  if (a->hash > b->hash) return +1;
+  return 0;
+}
+
+/* Try to place every group with more than one code, largest first,
+   with the given seed.  order lists the groups in decreasing size,
+   and first[g] gives the index of group g's first code in codes,
+   which is sorted by group.  Returns false if some group could not be
+   placed. */
+static _Bool place_groups(struct frozen *f, struct code *codes,
+                          const size_t *order, const size_t *first,
+                          unsigned char *used, size_t *pos)
+{
+  memset(used, 0, f->len);
+  for (size_t oi = 0; oi < f->ngroups; oi++) {
+    size_t g = order[oi];
+    size_t n = first[g + 1] - first[g];
+    if (n < 2) break;
+    struct code *c = &codes[first[g]];
+    uint32_t d;
+    for (d = 0; d < MAX_TRIES; d++) {
+      size_t i;
+      for (i = 0; i < n; i++) {
+        pos[i] = frozen_pos(f, c[i].m, d);
+        if (used[pos[i]]) break;
+        used[pos[i]] = 1;
+      }
+      if (i == n) break;
+      while (i > 0)
+        used[pos[--i]] = 0;
+    }
+    if (d == MAX_TRIES) return false;
+    f->disp[g] = d;
+  }
+  return true;
+}
+
+_Bool htab_freeze(htab self)
+{
+  if (self->frozen) return true;
+  if (self->persistent) return false;
+
+  struct frozen *f = malloc(sizeof *f);
+  if (!f) return false;
+  f->disp = NULL;
+  f->slot = f->extra = NULL;
+
+  /* Gather the entries, and sort them by code, to find the distinct
+     codes. */
+  size_t n = self->count;
+  struct code *codes = malloc((n ? n : 1) * sizeof *codes);
+  if (!codes) goto failed;
+  size_t k = 0;
+  for (size_t i = 0; i < self->len; i++)
+    for (struct entry *e = peek_head(self, i); e; e = e->next) {
+      codes[k].e = e;
+      codes[k].hash = e->hash;
+      k++;
+    }
+  assert(k == n);
+  qsort(codes, n, sizeof *codes, &cmp_code);
+
+  size_t distinct = 0;
+  for (size_t i = 0; i < n; i++)
+    if (i == 0 || codes[i].hash != codes[i - 1].hash)
+      distinct++;
+  if (distinct >= DIRECT) goto failed;
+  f->len = distinct;
+  f->nextra = n - distinct;
+  f->ngroups = distinct / GROUP_SIZE + 1;
+  f->disp = malloc(f->ngroups * sizeof f->disp[0]);
+  f->slot = malloc((distinct ? distinct : 1) * sizeof f->slot[0]);
+  f->extra = malloc((f->nextra ? f->nextra : 1) * sizeof f->extra[0]);
+  if (!f->disp || !f->slot || !f->extra) goto failed;
+
+  /* Keep only the first entry of each code in codes, and put the rest
+     in the extra array, chained from the slot they will join. */
+  size_t x = 0;
+  k = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (k > 0 && codes[i].hash == codes[k - 1].hash) {
+      struct fslot *s = &f->extra[x];
+      s->key = codes[i].e->key;
+      s->value = codes[i].e->value;
+      s->hash = codes[i].hash;
+      s->more = codes[k - 1].more;
+      codes[k - 1].more = ++x;
+    } else {
+      codes[k] = codes[i];
+      codes[k++].more = 0;
+    }
+  }
+
+  size_t *first = malloc((f->ngroups + 1) * sizeof *first);
+  size_t *order = malloc(f->ngroups * sizeof *order);
+  size_t *pos = malloc((distinct + 1) * sizeof *pos);
+  unsigned char *used = malloc(distinct + 1);
+  struct code *sorted = malloc((distinct ? distinct : 1) * sizeof *sorted);
+  _Bool placed = false;
+  if (first && order && pos && used && sorted) {
+    for (unsigned attempt = 0; !placed && attempt < MAX_SEEDS; attempt++) {
+      f->seed = mix(attempt + UINT64_C(0x2545f4914f6cdd1d));
+
+      /* Sort the codes by group with a counting sort. */
+      memset(first, 0, (f->ngroups + 1) * sizeof *first);
+      for (size_t i = 0; i < distinct; i++) {
+        codes[i].m = mix(codes[i].hash ^ f->seed);
+        codes[i].group = reduce(codes[i].m, f->ngroups);
+        first[codes[i].group + 1]++;
+      }
+      for (size_t g = 0; g < f->ngroups; g++)
+        first[g + 1] += first[g];
+      for (size_t i = 0; i < distinct; i++)
+        sorted[first[codes[i].group]++] = codes[i];
+      for (size_t g = f->ngroups; g > 0; g--)
+        first[g] = first[g - 1];
+      first[0] = 0;
+
+      /* Order the groups by decreasing size, with a counting sort. */
+      size_t maxsz = 0;
+      for (size_t g = 0; g < f->ngroups; g++)
+        if (first[g + 1] - first[g] > maxsz)
+          maxsz = first[g + 1] - first[g];
+      size_t *bysize = calloc(maxsz + 2, sizeof *bysize);
+      if (!bysize) break;
+      for (size_t g = 0; g < f->ngroups; g++)
+        bysize[maxsz - (first[g + 1] - first[g]) + 1]++;
+      for (size_t i = 0; i <= maxsz; i++)
+        bysize[i + 1] += bysize[i];
+      for (size_t g = 0; g < f->ngroups; g++)
+        order[bysize[maxsz - (first[g + 1] - first[g])]++] = g;
+      free(bysize);
+
+      placed = place_groups(f, sorted, order, first, used, pos);
+    }
+  }
+
+  if (placed) {
+    /* Give each single-code group a vacant slot directly, and fill the
+       slots. */
+    size_t vacant = 0;
+    for (size_t g = 0; g < f->ngroups; g++) {
+      size_t sz = first[g + 1] - first[g];
+      if (sz == 0)
+        f->disp[g] = 0;
+      else if (sz == 1) {
+        while (used[vacant])
+          vacant++;
+        used[vacant] = 1;
+        f->disp[g] = DIRECT | vacant;
+      }
+      for (size_t i = first[g]; i < first[g + 1]; i++) {
+        const struct code *c = &sorted[i];
+        uint32_t d = f->disp[g];
+        struct fslot *s =
+          &f->slot[d & DIRECT ? d & ~DIRECT : frozen_pos(f, c->m, d)];
+        s->key = c->e->key;
+        s->value = c->e->value;
+        s->hash = c->hash;
+        s->more = c->more;
+      }
+    }
+  }
+  free(first);
+  free(order);
+  free(pos);
+  free(used);
+  free(sorted);
+  if (!placed) goto failed;
+  free(codes);
+
+  /* The entries now belong to the frozen table. */
+  release_slabs(self);
+  free(self->base);
+  self->base = NULL;
+  self->len = 0;
+  self->frozen = f;
+  return true;
+
+ failed:
+  free(codes);
+  free(f->disp);
+  free(f->slot);
+  free(f->extra);
+  free(f);
+  return false;
+}
+
+_Bool htab_persist(htab self)
+{
+  if (self->persistent) return true;
+  if (self->frozen || self->readonly) return false;
+  return make_persistent(self);
+}
+
+htab htab_snapshot(htab self)
+{
+  if (!self->persistent) return NULL;
+
+  htab r = malloc(sizeof *r);
+  if (!r) return NULL;
+  *r = *self;
+  r->filter = NULL;
+  r->filter_stale = 0;
+  r->readonly = true;
+  if (r->proot)
+    ref_inc(r->proot);
+  return r;
+}
+
+/* Saved tables begin with a magic number, a format version and the
+   number of entries, and each entry is the length and bytes of its
+   key, then of its value.  All integers are little-endian. */
+#define IO_MAGIC "DDSH"
+#define IO_VERSION 1
+#define IO_HDR 16
+#define IO_BUF 65536
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+  for (int i = 0; i < 4; i++)
+    p[i] = v >> (i * 8);
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+  uint32_t v = 0;
+  for (int i = 4; i > 0; i--)
+    v = (v << 8) | p[i - 1];
+  return v;
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+  for (int i = 0; i < 8; i++)
+    p[i] = v >> (i * 8);
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+  uint64_t v = 0;
+  for (int i = 8; i > 0; i--)
+    v = (v << 8) | p[i - 1];
+  return v;
+}
+
+struct iobuf {
+  int fd;
+  size_t pos, len;
+  unsigned char data[IO_BUF];
+};
+
+static int write_all(int fd, const unsigned char *p, size_t n)
+{
+  while (n > 0) {
+    ssize_t rc = write(fd, p, n);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    p += rc;
+    n -= rc;
+  }
+  return 0;
+}
+
+static int flush_out(struct iobuf *b)
+{
+  if (write_all(b->fd, b->data, b->pos) < 0) return -1;
+  b->pos = 0;
+  return 0;
+}
+
+/* Get space for n bytes in the buffer, or NULL if it cannot hold
+   them or flushing fails. */
+static unsigned char *out_space(struct iobuf *b, size_t n)
+{
+  if (n > IO_BUF) return NULL;
+  if (IO_BUF - b->pos < n && flush_out(b) < 0) return NULL;
+  unsigned char *r = b->data + b->pos;
+  b->pos += n;
+  return r;
+}
+
+static int save_item(struct iobuf *b, const htab_codec *c, htab_const item)
+{
+  size_t n = (*c->size)(c->ctxt, item);
+  if (n > UINT32_MAX) {
+    errno = EFBIG;
+    return -1;
+  }
+  unsigned char *p = out_space(b, 4);
+  if (!p) return -1;
+  put_u32(p, n);
+  if (n <= IO_BUF) {
+    if (!(p = out_space(b, n))) return -1;
+    (*c->put)(c->ctxt, item, p);
+    return 0;
+  }
+
+  /* Encode an oversized item separately. */
+  if (flush_out(b) < 0) return -1;
+  if (!(p = malloc(n))) return -1;
+  (*c->put)(c->ctxt, item, p);
+  int rc = write_all(b->fd, p, n);
+  free(p);
+  return rc;
+}
+
+struct save_ctxt {
+  struct iobuf *buf;
+  const htab_codec *key, *val;
+  int rc;
+};
+
+static htab_apprc save_entry(void *ctxt, htab_const key, htab_obj val)
+{
+  struct save_ctxt *sc = ctxt;
+  if (save_item(sc->buf, sc->key, key) < 0 ||
+      save_item(sc->buf, sc->val, *get_const(&val)) < 0) {
+    sc->rc = -1;
+    return htab_STOP;
+  }
+  return 0;
+}
+
+int htab_save(htab self, int fd, const htab_codec *key, const htab_codec *val)
+{
+  struct iobuf *b = malloc(sizeof *b);
+  if (!b) return -1;
+  b->fd = fd;
+  b->pos = 0;
+
+  unsigned char *p = out_space(b, IO_HDR);
+  memcpy(p, IO_MAGIC, 4);
+  put_u32(p + 4, IO_VERSION);
+  put_u64(p + 8, self->count);
+
+  struct save_ctxt sc = { .buf = b, .key = key, .val = val, .rc = 0 };
+  htab_apply(self, &sc, &save_entry);
+  if (sc.rc == 0)
+    sc.rc = flush_out(b);
+  free(b);
+  return sc.rc;
+}
+
+/* Get the next n bytes from the buffer, reading more as necessary.
+   Returns NULL if they cannot fit, or if reading fails or ends
+   first. */
+static const unsigned char *in_bytes(struct iobuf *b, size_t n)
+{
+  if (n > IO_BUF) return NULL;
+  if (b->len - b->pos < n) {
+    memmove(b->data, b->data + b->pos, b->len - b->pos);
+    b->len -= b->pos;
+    b->pos = 0;
+    while (b->len < n) {
+      ssize_t rc = read(b->fd, b->data + b->len, IO_BUF - b->len);
+      if (rc < 0) {
+        if (errno == EINTR) continue;
+        return NULL;
+      }
+      if (rc == 0) {
+        errno = EINVAL;
+        return NULL;
+      }
+      b->len += rc;
+    }
+  }
+  const unsigned char *r = b->data + b->pos;
+  b->pos += n;
+  return r;
+}
+
+static int load_item(struct iobuf *b, const htab_codec *c, htab_obj *item)
+{
+  const unsigned char *p = in_bytes(b, 4);
+  if (!p) return -1;
+  size_t n = get_u32(p);
+  if (n <= IO_BUF) {
+    if (!(p = in_bytes(b, n))) return -1;
+    if (!(*c->get)(c->ctxt, item, p, n)) goto malformed;
+    return 0;
+  }
+
+  /* Gather an oversized item separately. */
+  unsigned char *big = malloc(n);
+  if (!big) return -1;
+  size_t got = b->len - b->pos;
+  memcpy(big, b->data + b->pos, got);
+  b->pos = b->len = 0;
+  while (got < n) {
+    ssize_t rc = read(b->fd, big + got, n - got);
+    if (rc < 0 && errno == EINTR) continue;
+    if (rc <= 0) {
+      if (rc == 0)
+        errno = EINVAL;
+      free(big);
+      return -1;
+    }
+    got += rc;
+  }
+  _Bool ok = (*c->get)(c->ctxt, item, big, n);
+  free(big);
+  if (ok) return 0;
+
+ malformed:
+  errno = EINVAL;
+  return -1;
+}
+
+int htab_load(htab self, int fd, const htab_codec *key, const htab_codec *val)
+{
+  if (self->frozen || self->readonly) {
+    errno = EPERM;
+    return -1;
+  }
+
+  struct iobuf *b = malloc(sizeof *b);
+  if (!b) return -1;
+  b->fd = fd;
+  b->pos = b->len = 0;
+
+  int rc = -1;
+  const unsigned char *p = in_bytes(b, IO_HDR);
+  if (!p) goto done;
+  if (memcmp(p, IO_MAGIC, 4) || get_u32(p + 4) != IO_VERSION) {
+    errno = EINVAL;
+    goto done;
+  }
+  uint64_t n = get_u64(p + 8);
+
+  /* Presizing is only an optimisation. */
+  if (n <= SIZE_MAX - self->count)
+    htab_reserve(self, self->count + n);
+
+  for (uint64_t i = 0; i < n; i++) {
+    htab_obj k, v;
+    if (load_item(b, key, &k) < 0) goto done;
+    if (load_item(b, val, &v) < 0) {
+      if (self->release_key)
+        (*self->release_key)(self->ctxt, k);
+      goto done;
+    }
+    size_t hv = htab_hash_key(self, *get_const(&k));
+    if (!put_owned(self, hv, k, v)) {
+      if (self->release_key)
+        (*self->release_key)(self->ctxt, k);
+      if (self->release_value)
+        (*self->release_value)(self->ctxt, v);
+      errno = ENOMEM;
+      goto done;
+    }
+  }
+  rc = 0;
+
+ done:
+  free(b);
+  return rc;
+}
+
+static size_t size_str(void *ctxt, htab_const item)
+{
+  return strlen(item.pointer);
+}
+
+static void put_str(void *ctxt, htab_const item, unsigned char *p)
+{
+  memcpy(p, item.pointer, strlen(item.pointer));
+}
+
+static _Bool get_str(void *ctxt, htab_obj *item,
+                     const unsigned char *p, size_t n)
+{
+  char *r = malloc(n + 1);
+  if (!r) return false;
+  memcpy(r, p, n);
+  r[n] = '\0';
+  item->pointer = r;
+  return true;
+}
+
+const htab_codec htab_codec_str = { &size_str, &put_str, &get_str, NULL };
+
+static size_t size_wcs(void *ctxt, htab_const item)
+{
+  return wcslen(item.pointer) * sizeof(wchar_t);
+}
+
+static void put_wcs(void *ctxt, htab_const item, unsigned char *p)
+{
+  memcpy(p, item.pointer, wcslen(item.pointer) * sizeof(wchar_t));
+}
+
+static _Bool get_wcs(void *ctxt, htab_obj *item,
+                     const unsigned char *p, size_t n)
+{
+  if (n % sizeof(wchar_t)) return false;
+  wchar_t *r = malloc(n + sizeof(wchar_t));
+  if (!r) return false;
+  memcpy(r, p, n);
+  r[n / sizeof(wchar_t)] = L'\0';
+  item->pointer = r;
+  return true;
+}
+
+const htab_codec htab_codec_wcs = { &size_wcs, &put_wcs, &get_wcs, NULL };
+
+static size_t size_u64(void *ctxt, htab_const item)
+{
+  return 8;
+}
+
+static void put_uint(void *ctxt, htab_const item, unsigned char *p)
+{
+  put_u64(p, item.unsigned_integer);
+}
+
+static _Bool get_uint(void *ctxt, htab_obj *item,
+                      const unsigned char *p, size_t n)
+{
+  if (n != 8) return false;
+  memset(item, 0, sizeof *item);
+  item->unsigned_integer = get_u64(p);
+  return true;
+}
+
+const htab_codec htab_codec_uint = { &size_u64, &put_uint, &get_uint, NULL };
+
+static void put_int(void *ctxt, htab_const item, unsigned char *p)
+{
+  put_u64(p, (uint64_t) item.integer);
+}
+
+static _Bool get_int(void *ctxt, htab_obj *item,
+                     const unsigned char *p, size_t n)
+{
+  if (n != 8) return false;
+  memset(item, 0, sizeof *item);
+  item->integer = (int64_t) get_u64(p);
+  return true;
+}
+
+const htab_codec htab_codec_int = { &size_u64, &put_int, &get_int, NULL };
+
+static size_t size_ptr(void *ctxt, htab_const item)
+{
+  return sizeof item.pointer;
+}
+
+static void put_ptr(void *ctxt, htab_const item, unsigned char *p)
+{
+  memcpy(p, &item.pointer, sizeof item.pointer);
+}
+
+static _Bool get_ptr(void *ctxt, htab_obj *item,
+                     const unsigned char *p, size_t n)
+{
+  if (n != sizeof item->pointer) return false;
+  memset(item, 0, sizeof *item);
+  memcpy(&item->pointer, p, n);
+  return true;
+}
+
+const htab_codec htab_codec_ptr = { &size_ptr, &put_ptr, &get_ptr, NULL };
+
 htab_DEFN(sp, const char *, void *, void *, pointer, pointer, NULL);
 htab_DEFN(ss, const char *, char *, const char *, pointer, pointer, NULL);
 htab_DEFN(wp, const wchar_t *, void *, void *, pointer, pointer, NULL);
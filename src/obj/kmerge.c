@@ -0,0 +1,208 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "ddslib/kmerge.h"
+
+static const void *array_next(void *ctxt)
+{
+  kmerge_array *a = ctxt;
+  const void *p;
+  if (a->pos == a->end) return NULL;
+  p = a->pos;
+  a->pos += a->size;
+  return p;
+}
+
+void kmerge_array_init(kmerge_run *run, kmerge_array *a,
+                       const void *base, size_t n, size_t size)
+{
+  a->pos = base;
+  a->end = a->pos + n * size;
+  a->size = size;
+  run->next = &array_next;
+  run->ctxt = a;
+}
+
+static const void *file_next(void *ctxt)
+{
+  kmerge_file *f = ctxt;
+  const void *p;
+
+  if (f->pos == f->len) {
+    /* Refill the buffer with whole records. */
+    size_t want = f->cap * f->size;
+    f->pos = f->len = 0;
+    while (f->len < want) {
+      ssize_t got = read(f->fd, f->buf + f->len, want - f->len);
+      if (got < 0) {
+        if (errno == EINTR) continue;
+        f->error = errno;
+        return NULL;
+      }
+      if (got == 0) break;
+      f->len += got;
+      if (f->len % f->size == 0) break;
+    }
+    if (f->len % f->size != 0) {
+      f->error = EIO;
+      f->len = 0;
+      return NULL;
+    }
+    if (f->len == 0) return NULL;
+  }
+  p = f->buf + f->pos;
+  f->pos += f->size;
+  return p;
+}
+
+int kmerge_file_init(kmerge_run *run, kmerge_file *f,
+                     int fd, size_t size, size_t cap)
+{
+  f->buf = malloc(size * cap);
+  if (!f->buf) return -1;
+  f->fd = fd;
+  f->error = 0;
+  f->size = size;
+  f->cap = cap;
+  f->len = f->pos = 0;
+  run->next = &file_next;
+  run->ctxt = f;
+  return 0;
+}
+
+void kmerge_file_term(kmerge_file *f)
+{
+  free(f->buf);
+  f->buf = NULL;
+}
+
+/* An exhausted run loses to all others, and ties go to the earlier
+   run. */
+static int beats(kmerge *m, size_t a, size_t b)
+{
+  int c;
+  if (!m->cur[b]) return 1;
+  if (!m->cur[a]) return 0;
+  c = (*m->cmp)(m->ctxt, m->cur[a], m->cur[b]);
+  return c < 0 || (c == 0 && a < b);
+}
+
+int kmerge_init(kmerge *m, kmerge_run *runs, size_t k, size_t size,
+                void *ctxt, int (*cmp)(void *, const void *, const void *))
+{
+  size_t i, *win;
+
+  m->runs = runs;
+  m->k = k;
+  m->size = size;
+  m->ctxt = ctxt;
+  m->cmp = cmp;
+  m->pending = 0;
+  m->cur = malloc((k ? k : 1) * sizeof *m->cur);
+  m->loser = malloc((k ? k : 1) * sizeof *m->loser);
+  win = malloc(2 * (k ? k : 1) * sizeof *win);
+  if (!m->cur || !m->loser || !win) {
+    free(m->cur);
+    free(m->loser);
+    free(win);
+    return -1;
+  }
+  if (k == 0) {
+    free(win);
+    return 0;
+  }
+
+  /* Run i is leaf k + i, and node j has children 2j and 2j + 1.  Play
+     every match once, keeping the winners only while building. */
+  for (i = 0; i < k; i++) {
+    m->cur[i] = (*runs[i].next)(runs[i].ctxt);
+    win[k + i] = i;
+  }
+  for (i = k - 1; i > 0; i--) {
+    size_t a = win[2 * i], b = win[2 * i + 1];
+    if (beats(m, a, b)) {
+      win[i] = a;
+      m->loser[i] = b;
+    } else {
+      win[i] = b;
+      m->loser[i] = a;
+    }
+  }
+  m->loser[0] = win[k > 1 ? 1 : k];
+  free(win);
+  return 0;
+}
+
+void kmerge_term(kmerge *m)
+{
+  free(m->cur);
+  free(m->loser);
+  m->cur = NULL;
+  m->loser = NULL;
+}
+
+/* Advance the winning run, and replay its matches up to the root. */
+static void advance(kmerge *m)
+{
+  size_t w = m->loser[0], j;
+  kmerge_run *run = &m->runs[w];
+
+  m->cur[w] = (*run->next)(run->ctxt);
+  for (j = (m->k + w) / 2; j > 0; j /= 2)
+    if (beats(m, m->loser[j], w)) {
+      size_t t = m->loser[j];
+      m->loser[j] = w;
+      w = t;
+    }
+  m->loser[0] = w;
+}
+
+const void *kmerge_next(kmerge *m)
+{
+  const void *p;
+
+  if (m->k == 0) return NULL;
+  if (m->pending)
+    advance(m);
+  p = m->cur[m->loser[0]];
+  m->pending = p != NULL;
+  return p;
+}
+
+size_t kmerge_read(kmerge *m, void *out, size_t max)
+{
+  char *to = out;
+  const void *p;
+  size_t n;
+
+  for (n = 0; n < max && (p = kmerge_next(m)); n++, to += m->size)
+    memcpy(to, p, m->size);
+  return n;
+}
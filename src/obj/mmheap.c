@@ -0,0 +1,191 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+
+#include "ddslib/mmheap.h"
+
+#define get_elem(R,O) ((mmheap_elem *) &(R)->memb[(char *) (O)])
+#define before(R,P,Q) ((*(R)->cmp)((R)->ctxt, (P), (Q)) < 0)
+
+/* On a max level, an element must precede another to be nearer the
+   root if it follows it in the sequence. */
+#define better(R,MAX,P,Q) ((MAX) ? before((R),(Q),(P)) : before((R),(P),(Q)))
+
+static int max_level(size_t i)
+{
+  int odd = 0;
+  for (i++; i > 1; i >>= 1)
+    odd = !odd;
+  return odd;
+}
+
+static void place(mmheap *r, size_t i, void *p)
+{
+  r->base[i] = p;
+  get_elem(r, p)->index = i;
+}
+
+static void swap(mmheap *r, size_t i, size_t j)
+{
+  void *p = r->base[i];
+  place(r, i, r->base[j]);
+  place(r, j, p);
+}
+
+/* Move an element up through the levels of its own kind. */
+static void push_up_level(mmheap *r, size_t i, int max)
+{
+  while (i > 2) {
+    size_t g = ((i - 1) / 2 - 1) / 2;
+    if (!better(r, max, r->base[i], r->base[g])) break;
+    swap(r, i, g);
+    i = g;
+  }
+}
+
+/* Move an element down to its place among its descendants, whose
+   subtrees are already in order. */
+static void push_down(mmheap *r, size_t i)
+{
+  int max = max_level(i);
+  size_t c, m, k, end;
+
+  while ((c = 2 * i + 1) < r->size) {
+    /* Find the best of the children and grandchildren. */
+    m = c;
+    if (c + 1 < r->size && better(r, max, r->base[c + 1], r->base[m]))
+      m = c + 1;
+    end = 4 * i + 7 < r->size ? 4 * i + 7 : r->size;
+    for (k = 4 * i + 3; k < end; k++)
+      if (better(r, max, r->base[k], r->base[m]))
+        m = k;
+
+    if (!better(r, max, r->base[m], r->base[i])) break;
+    swap(r, i, m);
+    if (m <= c + 1) break;
+
+    /* A grandchild has moved up, and its replacement may be on the
+       wrong side of the parent. */
+    if (better(r, !max, r->base[m], r->base[(m - 1) / 2]))
+      swap(r, m, (m - 1) / 2);
+    i = m;
+  }
+}
+
+/* Restore the order around an element that has just been put at i,
+   whose subtrees are already in order. */
+static void fix(mmheap *r, size_t i)
+{
+  int max = max_level(i);
+  size_t par;
+
+  if (i > 0 && better(r, !max, r->base[i], r->base[par = (i - 1) / 2])) {
+    /* It belongs among the other kind of level, and the displaced
+       parent may have to descend. */
+    swap(r, i, par);
+    push_up_level(r, par, !max);
+    push_down(r, i);
+  } else if (i > 2 &&
+             better(r, max, r->base[i],
+                    r->base[((i - 1) / 2 - 1) / 2])) {
+    push_up_level(r, i, max);
+  } else {
+    push_down(r, i);
+  }
+}
+
+void mmheap_term(mmheap *r)
+{
+  free(r->base);
+  r->base = 0;
+  r->size = r->cap = 0;
+}
+
+int mmheap_reserve(mmheap *r, size_t n)
+{
+  void **nb;
+  if (n <= r->cap) return 0;
+  nb = realloc(r->base, n * sizeof *nb);
+  if (!nb) return -1;
+  r->base = nb;
+  r->cap = n;
+  return 0;
+}
+
+int mmheap_insert(mmheap *r, void *p)
+{
+  if (r->size == r->cap &&
+      mmheap_reserve(r, r->cap ? r->cap * 2 : 16) < 0)
+    return -1;
+  place(r, r->size, p);
+  fix(r, r->size++);
+  return 0;
+}
+
+int mmheap_build(mmheap *r, void *const *elems, size_t n)
+{
+  size_t i;
+
+  if (mmheap_reserve(r, r->size + n) < 0) return -1;
+  for (i = 0; i < n; i++)
+    place(r, r->size + i, elems[i]);
+  r->size += n;
+  for (i = r->size / 2; i > 0; i--)
+    push_down(r, i - 1);
+  return 0;
+}
+
+void mmheap_remove(mmheap *r, void *p)
+{
+  size_t i = get_elem(r, p)->index;
+  void *last = r->base[--r->size];
+  if (i == r->size) return;
+  place(r, i, last);
+  fix(r, i);
+}
+
+void *mmheap_peek_max(const mmheap *r)
+{
+  if (r->size < 3)
+    return r->size ? r->base[r->size - 1] : 0;
+  return before(r, r->base[1], r->base[2]) ? r->base[2] : r->base[1];
+}
+
+void *mmheap_pop_min(mmheap *r)
+{
+  void *p;
+  if (r->size == 0) return 0;
+  p = r->base[0];
+  mmheap_remove(r, p);
+  return p;
+}
+
+void *mmheap_pop_max(mmheap *r)
+{
+  void *p = mmheap_peek_max(r);
+  if (p) mmheap_remove(r, p);
+  return p;
+}
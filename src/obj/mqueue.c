@@ -0,0 +1,158 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ddslib/mqueue.h"
+
+/* Each heap is kept on its own cache lines. */
+#define LINE 64
+
+struct mqueue_part {
+  pthread_mutex_t lock;
+  bheap heap;
+};
+
+#define get_part(Q,I) \
+  ((struct mqueue_part *) ((char *) (Q)->part + (I) * (Q)->stride))
+
+static __thread uint64_t rng_state;
+
+static size_t pick(size_t n)
+{
+  if (rng_state == 0) {
+    rng_state = (uintptr_t) &rng_state ^ (uint64_t) time(NULL) << 32;
+    if (rng_state == 0)
+      rng_state = 1;
+  }
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state % n;
+}
+
+int mqueue_setup(mqueue *q, size_t memb, void *ctxt,
+                 int (*cmp)(void *, const void *, const void *),
+                 size_t nparts)
+{
+  size_t i;
+  void *mem;
+
+  if (nparts < 1) nparts = 1;
+  q->stride = (sizeof(struct mqueue_part) + LINE - 1) / LINE * LINE;
+  if (posix_memalign(&mem, LINE, nparts * q->stride) != 0)
+    return -1;
+  q->part = mem;
+  q->nparts = nparts;
+  for (i = 0; i < nparts; i++) {
+    struct mqueue_part *p = get_part(q, i);
+    if (pthread_mutex_init(&p->lock, NULL) != 0) {
+      while (i > 0)
+        pthread_mutex_destroy(&get_part(q, --i)->lock);
+      free(mem);
+      return -1;
+    }
+    bheap_setup(&p->heap, memb, ctxt, cmp);
+  }
+  return 0;
+}
+
+void mqueue_term(mqueue *q)
+{
+  size_t i;
+  for (i = 0; i < q->nparts; i++)
+    pthread_mutex_destroy(&get_part(q, i)->lock);
+  free(q->part);
+  q->part = NULL;
+}
+
+void mqueue_insert(mqueue *q, void *e)
+{
+  struct mqueue_part *p;
+
+  /* Try random heaps until one is free. */
+  do
+    p = get_part(q, pick(q->nparts));
+  while (pthread_mutex_trylock(&p->lock) != 0);
+  bheap_insert(&p->heap, e);
+  pthread_mutex_unlock(&p->lock);
+}
+
+/* Visit the heaps in turn from a random one, waiting for each lock,
+   and pop the first element of the first heap that is not empty. */
+static void *scan(mqueue *q)
+{
+  size_t i, start = pick(q->nparts);
+  void *e = NULL;
+  for (i = 0; i < q->nparts && !e; i++) {
+    struct mqueue_part *p = get_part(q, (start + i) % q->nparts);
+    pthread_mutex_lock(&p->lock);
+    e = bheap_pop(&p->heap);
+    pthread_mutex_unlock(&p->lock);
+  }
+  return e;
+}
+
+void *mqueue_pop(mqueue *q)
+{
+  struct mqueue_part *a, *b, *best;
+  unsigned empty = 0;
+  void *e;
+
+  if (q->nparts == 1)
+    return scan(q);
+
+  /* Lock two random heaps, and take the better of their first
+     elements.  After many empty samples, check every heap. */
+  while (empty < 2 * q->nparts) {
+    size_t i = pick(q->nparts), j = pick(q->nparts - 1);
+    if (j >= i) j++;
+    a = get_part(q, i);
+    b = get_part(q, j);
+    if (pthread_mutex_trylock(&a->lock) != 0)
+      continue;
+    if (pthread_mutex_trylock(&b->lock) != 0) {
+      pthread_mutex_unlock(&a->lock);
+      continue;
+    }
+
+    if (!bheap_peek(&a->heap))
+      best = b;
+    else if (!bheap_peek(&b->heap))
+      best = a;
+    else
+      best = (*a->heap.cmp)(a->heap.ctxt, bheap_peek(&a->heap),
+                            bheap_peek(&b->heap)) <= 0 ? a : b;
+    e = bheap_pop(&best->heap);
+    pthread_mutex_unlock(&b->lock);
+    pthread_mutex_unlock(&a->lock);
+    if (e) return e;
+    empty++;
+  }
+  return scan(q);
+}
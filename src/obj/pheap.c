@@ -0,0 +1,147 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <assert.h>
+
+#include "ddslib/pheap.h"
+
+#define get_elem(R,O) ((pheap_elem *) &(R)->memb[(char *) (O)])
+
+/* Make the later of two roots the first child of the other, and
+   return the new root. */
+static void *link(pheap *r, void *a, void *b)
+{
+  pheap_elem *am, *bm;
+  void *t;
+
+  if ((*r->cmp)(r->ctxt, b, a) < 0) {
+    t = a;
+    a = b;
+    b = t;
+  }
+  am = get_elem(r, a);
+  bm = get_elem(r, b);
+  bm->next = am->child;
+  if (bm->next)
+    get_elem(r, bm->next)->prev = b;
+  bm->prev = a;
+  am->child = b;
+  return a;
+}
+
+/* Cut an element and its subtree from its parent. */
+static void detach(pheap *r, void *p)
+{
+  pheap_elem *pm = get_elem(r, p);
+  pheap_elem *prevm = get_elem(r, pm->prev);
+
+  if (prevm->child == p)
+    prevm->child = pm->next;
+  else
+    prevm->next = pm->next;
+  if (pm->next)
+    get_elem(r, pm->next)->prev = pm->prev;
+  pm->next = pm->prev = 0;
+}
+
+/* Combine a list of siblings into one tree, by linking them in pairs
+   from the left, then linking the pairs from the right. */
+static void *merge_pairs(pheap *r, void *p)
+{
+  void *acc = 0, *a, *b;
+
+  while (p) {
+    a = p;
+    b = get_elem(r, a)->next;
+    p = b ? get_elem(r, b)->next : 0;
+    get_elem(r, a)->next = get_elem(r, a)->prev = 0;
+    if (b) {
+      get_elem(r, b)->next = get_elem(r, b)->prev = 0;
+      a = link(r, a, b);
+    }
+
+    /* Stack the pairs through their next fields. */
+    get_elem(r, a)->next = acc;
+    acc = a;
+  }
+
+  p = 0;
+  while (acc) {
+    a = acc;
+    acc = get_elem(r, a)->next;
+    get_elem(r, a)->next = 0;
+    p = p ? link(r, p, a) : a;
+  }
+  return p;
+}
+
+void pheap_insert(pheap *r, void *p)
+{
+  pheap_elem *pm = get_elem(r, p);
+
+  pm->child = pm->next = pm->prev = 0;
+  r->first = r->first ? link(r, r->first, p) : p;
+  r->size++;
+}
+
+void pheap_remove(pheap *r, void *p)
+{
+  void *sub;
+
+  if (p != r->first)
+    detach(r, p);
+  sub = merge_pairs(r, get_elem(r, p)->child);
+  get_elem(r, p)->child = 0;
+  if (p == r->first)
+    r->first = sub;
+  else if (sub)
+    r->first = link(r, r->first, sub);
+  r->size--;
+}
+
+void *pheap_pop(pheap *r)
+{
+  void *p = pheap_peek(r);
+  if (p)
+    pheap_remove(r, p);
+  return p;
+}
+
+void pheap_decrease(pheap *r, void *p)
+{
+  if (p == r->first) return;
+  detach(r, p);
+  r->first = link(r, r->first, p);
+}
+
+void pheap_meld(pheap *r, pheap *o)
+{
+  assert(r->memb == o->memb);
+  if (o->first)
+    r->first = r->first ? link(r, r->first, o->first) : o->first;
+  r->size += o->size;
+  o->first = 0;
+  o->size = 0;
+}
@@ -0,0 +1,161 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include "ddslib/radixheap.h"
+
+#define get_elem(R,O) ((radixheap_elem *) ((char *) (O) + (R)->memb))
+#define get_obj(R,E) ((void *) ((char *) (E) - (R)->memb))
+
+static inline unsigned bucket_of(uint64_t key, uint64_t last)
+{
+  uint64_t x = key ^ last;
+  if (x == 0) return 0;
+#ifdef __GNUC__
+  return 64 - __builtin_clzll(x);
+#else
+  unsigned r = 0;
+  for ( ; x; x >>= 1)
+    r++;
+  return r;
+#endif
+}
+
+static void put(radixheap *r, radixheap_elem *e)
+{
+  unsigned b = bucket_of(e->key, r->last);
+  e->bucket = b;
+  dllist_append(&r->bucket[b], others, e);
+  if (b > 0)
+    r->used |= (uint64_t) 1 << (b - 1);
+}
+
+static void take(radixheap *r, radixheap_elem *e)
+{
+  unsigned b = e->bucket;
+  dllist_unlink(&r->bucket[b], others, e);
+  if (b > 0 && dllist_isempty(&r->bucket[b]))
+    r->used &= ~((uint64_t) 1 << (b - 1));
+}
+
+void radixheap_setup(radixheap *r, size_t memb)
+{
+  for (unsigned i = 0; i < 65; i++)
+    dllist_init(&r->bucket[i]);
+  r->last = 0;
+  r->used = 0;
+  r->memb = memb;
+  r->size = 0;
+}
+
+int radixheap_insert(radixheap *r, void *p, uint64_t key)
+{
+  radixheap_elem *e = get_elem(r, p);
+  if (key < r->last) return -1;
+  e->key = key;
+  put(r, e);
+  r->size++;
+  return 0;
+}
+
+void radixheap_remove(radixheap *r, void *p)
+{
+  take(r, get_elem(r, p));
+  r->size--;
+}
+
+int radixheap_decrease(radixheap *r, void *p, uint64_t key)
+{
+  radixheap_elem *e = get_elem(r, p);
+  if (key < r->last || key > e->key) return -1;
+  take(r, e);
+  e->key = key;
+  put(r, e);
+  return 0;
+}
+
+/* Make bucket 0 hold the least keys, by taking the least key from the
+   lowest occupied bucket as the new minimum, and spreading that
+   bucket's elements over the buckets below it. */
+static radixheap_elem *settle(radixheap *r)
+{
+  radixheap_elem *e, *min;
+  radixheap_bucket b;
+
+  if (!dllist_isempty(&r->bucket[0]))
+    return dllist_first(&r->bucket[0]);
+  if (!r->used)
+    return NULL;
+
+#ifdef __GNUC__
+  unsigned i = __builtin_ctzll(r->used) + 1;
+#else
+  unsigned i = 1;
+  while (!(r->used & ((uint64_t) 1 << (i - 1))))
+    i++;
+#endif
+  min = dllist_first(&r->bucket[i]);
+  for (e = min; e; e = dllist_next(others, e))
+    if (e->key < min->key)
+      min = e;
+  r->last = min->key;
+
+  b = r->bucket[i];
+  dllist_init(&r->bucket[i]);
+  r->used &= ~((uint64_t) 1 << (i - 1));
+  while ((e = dllist_first(&b))) {
+    dllist_unlink(&b, others, e);
+    put(r, e);
+  }
+  return dllist_first(&r->bucket[0]);
+}
+
+void *radixheap_peek(radixheap *r)
+{
+  radixheap_elem *e = settle(r);
+  return e ? get_obj(r, e) : NULL;
+}
+
+void *radixheap_pop(radixheap *r)
+{
+  radixheap_elem *e = settle(r);
+  if (!e) return NULL;
+  dllist_unlink(&r->bucket[0], others, e);
+  r->size--;
+  return get_obj(r, e);
+}
+
+size_t radixheap_pop_equal(radixheap *r, void **out, size_t max)
+{
+  radixheap_elem *e;
+  size_t n = 0;
+
+  if (!settle(r)) return 0;
+  while (n < max && (e = dllist_first(&r->bucket[0]))) {
+    dllist_unlink(&r->bucket[0], others, e);
+    out[n++] = get_obj(r, e);
+  }
+  r->size -= n;
+  return n;
+}
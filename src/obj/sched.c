@@ -0,0 +1,185 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ddslib/sched.h"
+
+/* Events are taken from the heap this many at a time. */
+#define BATCH 64
+
+static int event_cmp(void *ctxt, const void *a, const void *b)
+{
+  const sched_event *x = a, *y = b;
+  return x->when < y->when ? -1 : x->when > y->when;
+}
+
+uint64_t sched_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void *dispatch(void *vs)
+{
+  sched *s = vs;
+  sched_event *batch[BATCH], limit;
+  struct timespec ts;
+  size_t n, i;
+  sched_event *first;
+
+  pthread_mutex_lock(&s->lock);
+  while (!s->stopping) {
+    first = bheap_peek(&s->heap);
+    if (!first) {
+      pthread_cond_wait(&s->wake, &s->lock);
+      continue;
+    }
+    limit.when = sched_now();
+    if (first->when > limit.when) {
+      /* Sleep until the deadline itself, rather than for an interval
+         that was already shrinking. */
+      ts.tv_sec = first->when / 1000000000u;
+      ts.tv_nsec = first->when % 1000000000u;
+      pthread_cond_timedwait(&s->wake, &s->lock, &ts);
+      continue;
+    }
+
+    /* Take everything that is due, and run it unlocked. */
+    n = bheap_pop_until(&s->heap, &limit, (void **) batch, BATCH);
+    for (i = 0; i < n; i++)
+      batch[i]->queued = 0;
+    s->busy = 1;
+    pthread_mutex_unlock(&s->lock);
+    for (i = 0; i < n; i++)
+      (*batch[i]->run)(batch[i]->ctxt);
+    pthread_mutex_lock(&s->lock);
+    s->busy = 0;
+    s->batches++;
+    pthread_cond_broadcast(&s->idle);
+  }
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+int sched_init(sched *s)
+{
+  pthread_condattr_t attr;
+
+  bheap_init(&s->heap, sched_event, links, NULL, &event_cmp);
+  bheap_fifo(&s->heap);
+  s->batches = 0;
+  s->busy = s->stopping = 0;
+
+  if (pthread_mutex_init(&s->lock, NULL) != 0)
+    return -1;
+  if (pthread_condattr_init(&attr) != 0)
+    goto no_attr;
+  if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0 ||
+      pthread_cond_init(&s->wake, &attr) != 0)
+    goto no_wake;
+  if (pthread_cond_init(&s->idle, NULL) != 0)
+    goto no_idle;
+  if (pthread_create(&s->thread, NULL, &dispatch, s) != 0)
+    goto no_thread;
+  pthread_condattr_destroy(&attr);
+  return 0;
+
+ no_thread:
+  pthread_cond_destroy(&s->idle);
+ no_idle:
+  pthread_cond_destroy(&s->wake);
+ no_wake:
+  pthread_condattr_destroy(&attr);
+ no_attr:
+  pthread_mutex_destroy(&s->lock);
+  return -1;
+}
+
+void sched_term(sched *s)
+{
+  sched_event *e;
+
+  pthread_mutex_lock(&s->lock);
+  s->stopping = 1;
+  pthread_cond_signal(&s->wake);
+  pthread_mutex_unlock(&s->lock);
+  pthread_join(s->thread, NULL);
+
+  while ((e = bheap_pop(&s->heap)))
+    e->queued = 0;
+  pthread_cond_destroy(&s->idle);
+  pthread_cond_destroy(&s->wake);
+  pthread_mutex_destroy(&s->lock);
+}
+
+void sched_at(sched *s, sched_event *e, uint64_t when)
+{
+  int earliest;
+
+  pthread_mutex_lock(&s->lock);
+  if (e->queued)
+    bheap_remove(&s->heap, e);
+  e->when = when;
+  e->queued = 1;
+  bheap_insert(&s->heap, e);
+
+  /* The dispatcher need only wake if its deadline has moved
+     earlier. */
+  earliest = bheap_peek(&s->heap) == e;
+  pthread_mutex_unlock(&s->lock);
+  if (earliest)
+    pthread_cond_signal(&s->wake);
+}
+
+int sched_cancel(sched *s, sched_event *e)
+{
+  int was;
+
+  pthread_mutex_lock(&s->lock);
+  was = e->queued;
+  if (was) {
+    bheap_remove(&s->heap, e);
+    e->queued = 0;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return was;
+}
+
+void sched_sync(sched *s)
+{
+  unsigned long batch;
+
+  if (pthread_equal(pthread_self(), s->thread))
+    return;
+  pthread_mutex_lock(&s->lock);
+  batch = s->batches;
+  while (s->busy && s->batches == batch)
+    pthread_cond_wait(&s->idle, &s->lock);
+  pthread_mutex_unlock(&s->lock);
+}
@@ -0,0 +1,94 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "ddslib/aheap.h"
+
+struct mystr {
+  aheap_elem links;
+  int val;
+};
+
+static int mycmp(void *n, const void *v1, const void *v2)
+{
+  const struct mystr *m1 = v1, *m2 = v2;
+  return m1->val - m2->val;
+}
+
+#define COUNT 1000
+
+int main()
+{
+  static struct mystr elems[COUNT];
+  static int present[COUNT];
+  aheap heap;
+  int i, lastval, failed = 0;
+  struct mystr *p;
+
+  srand(time(NULL));
+
+  aheap_init(&heap, struct mystr, links, NULL, &mycmp);
+
+  for (i = 0; i < COUNT; i++) {
+    elems[i].val = rand() % 500;
+    if (aheap_insert(&heap, &elems[i]) < 0) {
+      fprintf(stderr, "Could not grow heap.\n");
+      return EXIT_FAILURE;
+    }
+    present[i] = 1;
+  }
+
+  /* Remove a third at random positions, using their handles. */
+  for (i = 0; i < COUNT; i += 3) {
+    aheap_remove(&heap, &elems[i]);
+    present[i] = 0;
+  }
+
+  lastval = -1;
+  while ((p = aheap_pop(&heap))) {
+    if (p->val < lastval) {
+      printf("Test failed: %d after %d\n", p->val, lastval);
+      failed = 1;
+    }
+    if (!present[p - elems]) {
+      printf("Test failed: removed element %d popped\n", (int) (p - elems));
+      failed = 1;
+    }
+    present[p - elems] = 0;
+    lastval = p->val;
+  }
+  for (i = 0; i < COUNT; i++)
+    if (present[i]) {
+      printf("Test failed: element %d lost\n", i);
+      failed = 1;
+    }
+
+  aheap_term(&heap);
+  printf("All tests complete.\n");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ddslib/bloom.h"
+
+int main(void)
+{
+  const size_t n = 100000;
+  bloom filter = bloom_open(n, 10);
+  if (filter == NULL) {
+    fprintf(stderr, "Could not open filter.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < n; i++)
+    bloom_add(filter, i * 2);
+
+  int failures = 0;
+  for (size_t i = 0; i < n; i++)
+    if (!bloom_tst(filter, i * 2)) {
+      printf("Test failed: %zu not found\n", i * 2);
+      failures++;
+    }
+
+  size_t fp = 0;
+  for (size_t i = 0; i < n; i++)
+    fp += bloom_tst(filter, i * 2 + 1);
+  printf("False positives: %zu of %zu\n", fp, n);
+  if (fp > n / 20) {
+    printf("Test failed: too many false positives\n");
+    failures++;
+  }
+
+  bloom_clear(filter);
+  for (size_t i = 0; i < n; i++)
+    fp += bloom_tst(filter, i * 2);
+  if (fp > n / 20) {
+    printf("Test failed: filter not cleared\n");
+    failures++;
+  }
+
+  bloom_close(filter);
+  printf("All tests complete.\n");
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "ddslib/dheap.h"
+
+struct mystr {
+  dheap_elem links;
+  int val;
+};
+
+#define COUNT 1000
+
+int main()
+{
+  static struct mystr elems[COUNT];
+  static int present[COUNT];
+  dheap heap;
+  int i, lastval, failed = 0;
+  int64_t key;
+  struct mystr *p;
+
+  srand(time(NULL));
+
+  dheap_init(&heap, struct mystr, links);
+
+  for (i = 0; i < COUNT; i++) {
+    elems[i].val = rand() % 500;
+    if (dheap_insert(&heap, &elems[i], elems[i].val) < 0) {
+      fprintf(stderr, "Could not grow heap.\n");
+      return EXIT_FAILURE;
+    }
+    present[i] = 1;
+  }
+
+  /* Remove a third at random positions, using their handles. */
+  for (i = 0; i < COUNT; i += 3) {
+    dheap_remove(&heap, &elems[i]);
+    present[i] = 0;
+  }
+
+  lastval = -1;
+  while (dheap_peekkey(&heap, &key)) {
+    p = dheap_pop(&heap);
+    if (key != p->val) {
+      printf("Test failed: peeked %d, popped %d\n", (int) key, p->val);
+      failed = 1;
+    }
+    if (p->val < lastval) {
+      printf("Test failed: %d after %d\n", p->val, lastval);
+      failed = 1;
+    }
+    if (!present[p - elems]) {
+      printf("Test failed: removed element %d popped\n", (int) (p - elems));
+      failed = 1;
+    }
+    present[p - elems] = 0;
+    lastval = p->val;
+  }
+  for (i = 0; i < COUNT; i++)
+    if (present[i]) {
+      printf("Test failed: element %d lost\n", i);
+      failed = 1;
+    }
+
+  dheap_term(&heap);
+  printf("All tests complete.\n");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
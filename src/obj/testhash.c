@@ -25,9 +25,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include <pthread.h>
 
 #include "ddslib/htab.h"
 
+/* A deliberately poor hash, so that many keys share codes */
+static size_t first_char(void *ctxt, htab_const key)
+{
+  return *(const unsigned char *) key.pointer;
+}
+
+/* An equality function that counts its uses */
+static unsigned long eq_calls;
+
+static _Bool same_str(void *ctxt, htab_const a, htab_const b)
+{
+  eq_calls++;
+  return strcmp(a.pointer, b.pointer) == 0;
+}
+
 static void tass(htab t, const char *key, const char *val)
 {
   const char *actual = htab_getss(t, key);
@@ -36,6 +55,113 @@ static void tass(htab t, const char *key, const char *val)
     printf("Test failed: %s yielded %s, not %s\n", key, actual, val);
 }
 
+static htab_apprc count_entry(void *ctxt, htab_const key, htab_obj val)
+{
+  ++*(size_t *) ctxt;
+  return 0;
+}
+
+static htab_apprc remove_entry(void *ctxt, htab_const key, htab_obj val)
+{
+  return htab_REMOVE;
+}
+
+/* One thread modifies a table, and hands snapshots of it to several
+   readers.  In version v, the table holds the version under "version",
+   and each w in the last WINDOW versions under wkey(w).  Writing
+   continues until each reader has checked CHECKS snapshots. */
+#define READERS 4
+#define WINDOW 100
+#define CHECKS 200
+
+static char wkeys[WINDOW * 5][20];
+static pthread_mutex_t slot_lock = PTHREAD_MUTEX_INITIALIZER;
+static htab slot[READERS];
+static unsigned checked[READERS];
+static _Bool writing = 1;
+
+static void *read_snapshots(void *vp)
+{
+  const int me = (htab *) vp - slot;
+  for (;;) {
+    pthread_mutex_lock(&slot_lock);
+    htab snap = slot[me];
+    slot[me] = NULL;
+    if (snap)
+      checked[me]++;
+    _Bool more = writing;
+    pthread_mutex_unlock(&slot_lock);
+    if (!snap) {
+      if (!more) break;
+      sched_yield();
+      continue;
+    }
+
+    uintmax_t v = htab_getsu(snap, "version");
+    uintmax_t lo = v < WINDOW ? 0 : v - WINDOW + 1;
+    for (uintmax_t w = lo; w <= v; w++) {
+      const char *key = wkeys[w % (sizeof wkeys / sizeof wkeys[0])];
+      if (htab_getsu(snap, key) != w)
+        printf("Test failed: version %ju has %s as %ju\n",
+               v, key, htab_getsu(snap, key));
+    }
+    size_t seen = 0;
+    htab_apply(snap, &seen, &count_entry);
+    if (seen != v - lo + 2)
+      printf("Test failed: version %ju has %zu entries\n", v, seen);
+    htab_close(snap);
+  }
+  return NULL;
+}
+
+static void test_threads(void)
+{
+  const size_t nkeys = sizeof wkeys / sizeof wkeys[0];
+  for (size_t i = 0; i < nkeys; i++)
+    sprintf(wkeys[i], "window-%zu", i);
+  htab table = htab_open(101, NULL, &htab_hash_str, &htab_cmp_str,
+                         &htab_copy_str, NULL, &htab_release_free, NULL);
+  if (!htab_persist(table))
+    printf("Test failed: could not make table persistent\n");
+  htab_putsu(table, "version", 0);
+  htab_putsu(table, wkeys[0], 0);
+  htab snap = htab_snapshot(table);
+  if (!snap) {
+    printf("Test failed: no snapshot for threads\n");
+    htab_close(table);
+    return;
+  }
+  htab_close(snap);
+
+  pthread_t reader[READERS];
+  for (int i = 0; i < READERS; i++)
+    pthread_create(&reader[i], NULL, &read_snapshots, &slot[i]);
+
+  for (uintmax_t v = 1; writing; v++) {
+    htab_putsu(table, wkeys[v % nkeys], v);
+    if (v >= WINDOW && !htab_delsu(table, wkeys[(v - WINDOW) % nkeys]))
+      printf("Test failed: version %ju lost %ju\n", v, v - WINDOW);
+    htab_putsu(table, "version", v);
+    pthread_mutex_lock(&slot_lock);
+    _Bool done = 1;
+    for (int i = 0; i < READERS; i++) {
+      if (!slot[i])
+        slot[i] = htab_snapshot(table);
+      if (checked[i] < CHECKS)
+        done = 0;
+    }
+    if (done)
+      writing = 0;
+    pthread_mutex_unlock(&slot_lock);
+  }
+
+  for (int i = 0; i < READERS; i++) {
+    pthread_join(reader[i], NULL);
+    htab_close(slot[i]);
+  }
+  htab_close(table);
+}
+
 int main(int argc, const char *const *argv)
 {
   htab table;
@@ -51,6 +177,7 @@ int main(int argc, const char *const *argv)
     fprintf(stderr, "Could not open table.\n");
     exit(EXIT_FAILURE);
   }
+  htab_seteq(table, &same_str);
 
   htab_putss(table, "key-1", "value-1.1");
   htab_putss(table, "key-2", "value-2.1");
@@ -60,6 +187,8 @@ int main(int argc, const char *const *argv)
 
   tass(table, "key-3", "value-3.1");
   tass(table, "key-5", "value-5.1");
+  if (eq_calls == 0)
+    printf("Test failed: equality function not used\n");
 
   htab_putss(table, "key-4", "value-4.2");
   htab_putss(table, "key-2", "value-2.2");
@@ -70,7 +199,241 @@ int main(int argc, const char *const *argv)
   tass(table, "key-4", "value-4.2");
   tass(table, "key-5", "value-5.1");
 
-  printf("All tests complete.\n");
+  if (!htab_bloom(table, 10)) {
+    fprintf(stderr, "Could not attach filter.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  char key[40], val[40];
+  for (int i = 0; i < 10000; i++) {
+    sprintf(key, "bulk-%d", i);
+    sprintf(val, "value-%d", i);
+    htab_putss(table, key, val);
+  }
+  tass(table, "key-3", "value-3.2");
+  tass(table, "bulk-1234", "value-1234");
+  if (htab_tstss(table, "missing"))
+    printf("Test failed: missing yielded %s\n", htab_getss(table, "missing"));
+
+  for (int i = 0; i < 10000; i += 2) {
+    sprintf(key, "bulk-%d", i);
+    htab_delss(table, key);
+  }
+  for (int i = 0; i < 10000; i++) {
+    sprintf(key, "bulk-%d", i);
+    if (htab_tstss(table, key) != (i % 2))
+      printf("Test failed: %s %s\n", key, i % 2 ? "lost" : "retained");
+  }
+  tass(table, "key-5", "value-5.1");
+
+  /* One code serves several tables with the same hash function. */
+  htab other = htab_open(7, NULL, &htab_hash_str, &htab_cmp_str,
+                         &htab_copy_str, &htab_copy_str,
+                         &htab_release_free, &htab_release_free);
+  size_t code = htab_hash_key(table, (htab_const) { .pointer = "key-5" });
+  htab_put_hashed(other, (htab_const) { .pointer = "key-5" }, code,
+                  (htab_const) { .pointer = "other-5" });
+  tass(other, "key-5", "other-5");
+  htab_obj found;
+  if (!htab_get_hashed(table, (htab_const) { .pointer = "key-5" }, code,
+                       &found) || strcmp(found.pointer, "value-5.1"))
+    printf("Test failed: hashed search of key-5\n");
+  if (htab_pop_hashed(other, (htab_const) { .pointer = "key-5" }, code,
+                      NULL) != htab_REMOVED || htab_tstss(other, "key-5"))
+    printf("Test failed: hashed removal of key-5\n");
+  htab_close(other);
+
+  htab_clear(table);
+  if (htab_tstss(table, "key-5"))
+    printf("Test failed: key-5 survived clearing\n");
+  htab_putss(table, "key-6", "value-6.1");
+  tass(table, "key-6", "value-6.1");
+
+  htab_clear_keep_capacity(table);
+  if (htab_tstss(table, "key-6"))
+    printf("Test failed: key-6 survived clearing\n");
+  htab_putss(table, "key-7", "value-7.1");
+  tass(table, "key-7", "value-7.1");
+
   htab_close(table);
+
+  /* Without release functions, clearing is constant-time. */
+  static char keys[500][20];
+  for (int i = 0; i < 500; i++)
+    sprintf(keys[i], "scratch-%d", i);
+  table = htab_open(101, NULL, &htab_hash_str, &htab_cmp_str,
+                    NULL, NULL, NULL, NULL);
+  for (int round = 0; round < 100; round++) {
+    for (int i = 0; i < 500; i++)
+      htab_putsu(table, keys[i], round);
+    if (htab_getsu(table, "scratch-7") != (uintmax_t) round)
+      printf("Test failed: round %d\n", round);
+    if (round % 2)
+      htab_clear(table);
+    else
+      htab_clear_keep_capacity(table);
+    if (htab_tstsu(table, "scratch-7"))
+      printf("Test failed: scratch-7 survived round %d\n", round);
+  }
+
+  /* Searches, removals and traversals of a cleared table must find
+     nothing, and leave it ready for insertion. */
+  for (int i = 0; i < 500; i++)
+    htab_putsu(table, keys[i], i);
+  htab_clear_keep_capacity(table);
+  for (int i = 0; i < 500; i++)
+    if (htab_tstsu(table, keys[i]) || htab_delsu(table, keys[i]))
+      printf("Test failed: %s survived clearing\n", keys[i]);
+  size_t seen = 0;
+  htab_apply(table, &seen, &count_entry);
+  if (seen != 0)
+    printf("Test failed: %zu entries survived clearing\n", seen);
+  for (int i = 0; i < 500; i += 5)
+    htab_putsu(table, keys[i], i + 1);
+  for (int i = 0; i < 500; i++)
+    if (htab_getsu(table, keys[i]) != (uintmax_t) (i % 5 ? 0 : i + 1))
+      printf("Test failed: %s after clearing\n", keys[i]);
+  seen = 0;
+  htab_apply(table, &seen, &count_entry);
+  if (seen != 100)
+    printf("Test failed: %zu entries after clearing\n", seen);
+
+  /* Emptying a table by removal releases its memory, and it must
+     still work afterwards, whichever way the entries were removed. */
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 500; i++)
+      htab_putsu(table, keys[i], i + 2);
+    if (round)
+      htab_apply(table, NULL, &remove_entry);
+    else
+      for (int i = 0; i < 500; i++)
+        htab_delsu(table, keys[i]);
+    seen = 0;
+    htab_apply(table, &seen, &count_entry);
+    if (seen != 0)
+      printf("Test failed: %zu entries survived removal\n", seen);
+    for (int i = 0; i < 500; i += 3)
+      htab_putsu(table, keys[i], i + 3);
+    for (int i = 0; i < 500; i++)
+      if (htab_getsu(table, keys[i]) != (uintmax_t) (i % 3 ? 0 : i + 3))
+        printf("Test failed: %s after emptying\n", keys[i]);
+  }
+  htab_close(table);
+
+  /* Frozen tables must find every key, whether it shares a code or
+     not, and reject modification. */
+  for (int variant = 0; variant < 2; variant++) {
+    table = htab_open(101, NULL, variant ? &first_char : &htab_hash_str,
+                      &htab_cmp_str, NULL, &htab_copy_str,
+                      NULL, &htab_release_free);
+    for (int i = 0; i < 500; i += 2) {
+      sprintf(val, "value-%d", i);
+      htab_putss(table, keys[i], val);
+    }
+    if (!htab_freeze(table))
+      printf("Test failed: could not freeze variant %d\n", variant);
+    for (int i = 0; i < 500; i++) {
+      sprintf(val, "value-%d", i);
+      const char *actual = htab_getss(table, keys[i]);
+      if (i % 2 ? actual != NULL : !actual || strcmp(actual, val))
+        printf("Test failed: frozen %s yielded %s\n", keys[i],
+               actual ? actual : "nothing");
+    }
+    if (htab_putss(table, keys[1], "value-1"))
+      printf("Test failed: frozen table accepted insertion\n");
+    if (htab_delss(table, keys[0]))
+      printf("Test failed: frozen table accepted removal\n");
+    htab_close(table);
+  }
+
+  /* Snapshots must be unaffected by later changes, and survive the
+     table, whether keys share a code or not. */
+  for (int variant = 0; variant < 2; variant++) {
+    table = htab_open(101, NULL, variant ? &first_char : &htab_hash_str,
+                      &htab_cmp_str, &htab_copy_str, &htab_copy_str,
+                      &htab_release_free, &htab_release_free);
+    for (int i = 0; i < 500; i += 2) {
+      sprintf(val, "value-%d", i);
+      htab_putss(table, keys[i], val);
+    }
+    if (htab_snapshot(table))
+      printf("Test failed: snapshot of chained variant %d\n", variant);
+    if (!htab_persist(table))
+      printf("Test failed: could not make variant %d persistent\n",
+             variant);
+    htab snap = htab_snapshot(table);
+    if (!snap)
+      printf("Test failed: no snapshot of variant %d\n", variant);
+    for (int i = 0; i < 500; i++) {
+      sprintf(val, "value-%d.1", i);
+      if (i % 3 == 0)
+        htab_delss(table, keys[i]);
+      else
+        htab_putss(table, keys[i], val);
+    }
+    htab snap2 = htab_snapshot(table);
+    if (htab_putss(snap, keys[1], "value-1"))
+      printf("Test failed: snapshot accepted insertion\n");
+    if (htab_del(snap, (htab_const) { .pointer = keys[0] }) != htab_FAILED)
+      printf("Test failed: snapshot accepted removal\n");
+    if (htab_del(table, (htab_const) { .pointer = keys[0] }) != htab_ABSENT)
+      printf("Test failed: removed entry found again\n");
+    htab_close(table);
+
+    for (int i = 0; i < 500; i++) {
+      const char *actual = htab_getss(snap, keys[i]);
+      sprintf(val, "value-%d", i);
+      if (i % 2 ? actual != NULL : !actual || strcmp(actual, val))
+        printf("Test failed: snapshot %s yielded %s\n", keys[i],
+               actual ? actual : "nothing");
+      actual = htab_getss(snap2, keys[i]);
+      sprintf(val, "value-%d.1", i);
+      if (i % 3 == 0 ? actual != NULL : !actual || strcmp(actual, val))
+        printf("Test failed: second snapshot %s yielded %s\n", keys[i],
+               actual ? actual : "nothing");
+    }
+    htab_close(snap);
+    htab_close(snap2);
+  }
+
+  test_threads();
+
+  /* A saved table must load into chained and persistent tables alike,
+     including a value too big for the buffer. */
+  static char big[100000];
+  memset(big, 'x', sizeof big - 1);
+  table = htab_open(7, NULL, &htab_hash_str, &htab_cmp_str,
+                    &htab_copy_str, &htab_copy_str,
+                    &htab_release_free, &htab_release_free);
+  for (int i = 0; i < 500; i++) {
+    sprintf(val, "value-%d", i);
+    htab_putss(table, keys[i], i == 250 ? big : val);
+  }
+  FILE *fp = tmpfile();
+  if (!fp || htab_save(table, fileno(fp), &htab_codec_str, &htab_codec_str))
+    printf("Test failed: could not save\n");
+  htab_close(table);
+  for (int variant = 0; variant < 2; variant++) {
+    table = htab_open(1, NULL, &htab_hash_str, &htab_cmp_str,
+                      &htab_copy_str, &htab_copy_str,
+                      &htab_release_free, &htab_release_free);
+    htab_putss(table, keys[0], "stale");
+    htab snap = variant && htab_persist(table) ? htab_snapshot(table) : NULL;
+    lseek(fileno(fp), 0, SEEK_SET);
+    if (htab_load(table, fileno(fp), &htab_codec_str, &htab_codec_str))
+      printf("Test failed: could not load variant %d\n", variant);
+    for (int i = 0; i < 500; i++) {
+      sprintf(val, "value-%d", i);
+      tass(table, keys[i], i == 250 ? big : val);
+    }
+    if (snap) {
+      tass(snap, keys[0], "stale");
+      htab_close(snap);
+    }
+    htab_close(table);
+  }
+  fclose(fp);
+
+  printf("All tests complete.\n");
   return EXIT_SUCCESS;
 }
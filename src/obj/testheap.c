@@ -25,13 +25,17 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <limits.h>
 #include <assert.h>
 
 #include "ddslib/bheap.h"
+#include "ddslib/dllist.h"
 
 struct mystr {
   bheap_elem links;
+  dllist_elem(struct mystr) others;
   int val;
 };
 
@@ -52,6 +56,454 @@ char *myprint(void *n, const void *v)
   return string;
 }
 
+#define BULK 1000
+
+/* A specialised heap with an inlined comparison */
+bheap_DECL(iheap, struct ielem);
+
+struct ielem {
+  iheap_elem links;
+  int val;
+};
+
+#define ICMP(C, A, B) ((A)->val < (B)->val ? -1 : (A)->val > (B)->val)
+
+bheap_IMPL(iheap, struct ielem, links, ICMP);
+
+/* Pop everything, checking the order and count. */
+static void drain(bheap *heap, size_t expected, const char *what)
+{
+  struct mystr *p;
+  int lastval = -1;
+  size_t got = 0;
+
+  if (heap->size != expected)
+    printf("Test failed: %s has %lu, not %lu\n", what,
+           (unsigned long) heap->size, (unsigned long) expected);
+  while ((p = bheap_pop(heap))) {
+    if (p->val < lastval)
+      printf("Test failed: %s yielded %d after %d\n", what, p->val, lastval);
+    lastval = p->val;
+    got++;
+  }
+  if (got != expected)
+    printf("Test failed: %s yielded %lu, not %lu\n", what,
+           (unsigned long) got, (unsigned long) expected);
+}
+
+static void test_bulk(void)
+{
+  static struct mystr elems[BULK];
+  static void *ptrs[BULK];
+  dllist_hdr(struct mystr) list;
+  bheap heap;
+  size_t i, n;
+
+  for (i = 0; i < BULK; i++) {
+    elems[i].val = rand() % 100;
+    ptrs[i] = &elems[i];
+  }
+
+  for (n = 0; n <= BULK; n += n < 20 ? 1 : 97) {
+    bheap_init(&heap, struct mystr, links, NULL, &mycmp);
+    bheap_build(&heap, ptrs, n);
+    drain(&heap, n, "array");
+
+    dllist_init(&list);
+    for (i = 0; i < n; i++)
+      dllist_append(&list, others, &elems[i]);
+    bheap_init(&heap, struct mystr, links, NULL, &mycmp);
+    bheap_build_dllist(&heap, &list, struct mystr, others);
+    drain(&heap, n, "list");
+
+    /* Add a small batch, then a large one. */
+    bheap_init(&heap, struct mystr, links, NULL, &mycmp);
+    bheap_build(&heap, ptrs, n / 2);
+    bheap_insert_many(&heap, ptrs + n / 2, n / 20);
+    bheap_insert_many(&heap, ptrs + n / 2 + n / 20, n - n / 2 - n / 20);
+    drain(&heap, n, "batch");
+  }
+}
+
+/* Change priorities in place, in both directions. */
+static void test_update(void)
+{
+  static struct mystr elems[BULK];
+  static void *ptrs[BULK];
+  bheap heap;
+  size_t i;
+
+  for (i = 0; i < BULK; i++) {
+    elems[i].val = rand() % 100;
+    ptrs[i] = &elems[i];
+  }
+  bheap_init(&heap, struct mystr, links, NULL, &mycmp);
+  bheap_build(&heap, ptrs, BULK);
+  for (i = 0; i < BULK; i += 7) {
+    int old = elems[i].val;
+    elems[i].val = rand() % 100;
+    if (i % 2)
+      bheap_update(&heap, &elems[i]);
+    else if (elems[i].val < old)
+      bheap_decrease(&heap, &elems[i]);
+    else
+      bheap_increase(&heap, &elems[i]);
+  }
+  drain(&heap, BULK, "updated");
+}
+
+/* Batches must come out in order, and topk must not disturb the
+   heap. */
+static void test_batch(void)
+{
+  static struct mystr elems[BULK], limit;
+  static void *ptrs[BULK], *top[BULK], *out[BULK];
+  bheap heap;
+  size_t i, n;
+  ptrdiff_t k;
+
+  for (i = 0; i < BULK; i++) {
+    elems[i].val = rand() % 100;
+    ptrs[i] = &elems[i];
+  }
+  bheap_init(&heap, struct mystr, links, NULL, &mycmp);
+  bheap_build(&heap, ptrs, BULK);
+
+  k = bheap_topk(&heap, top, 50);
+  n = bheap_pop_many(&heap, out, 50);
+  if (k != 50 || n != 50)
+    printf("Test failed: topk gave %ld, pop_many %lu\n",
+           (long) k, (unsigned long) n);
+  for (i = 1; i < n; i++)
+    if (((struct mystr *) top[i])->val != ((struct mystr *) out[i])->val ||
+        mycmp(NULL, out[i - 1], out[i]) > 0)
+      printf("Test failed: batch element %lu\n", (unsigned long) i);
+
+  limit.val = 30;
+  n = bheap_pop_until(&heap, &limit, out, BULK);
+  for (i = 0; i < n; i++)
+    if (((struct mystr *) out[i])->val > 30)
+      printf("Test failed: %d popped before 30\n",
+             ((struct mystr *) out[i])->val);
+  if (bheap_peek(&heap) &&
+      ((struct mystr *) bheap_peek(&heap))->val <= 30)
+    printf("Test failed: 30 or less left behind\n");
+  drain(&heap, BULK - 50 - n, "remainder");
+}
+
+/* Batches must yield exactly what single pops would, with cancelled
+   elements and insertions in between. */
+static void test_batch_order(void)
+{
+  static struct mystr elems[2][BULK];
+  static void *out[BULK];
+  bheap heap[2];
+  size_t i, j, n, live = 0;
+  int h;
+
+  for (h = 0; h < 2; h++) {
+    bheap_init(&heap[h], struct mystr, links, NULL, &mycmp);
+    bheap_fifo(&heap[h]);
+    bheap_lazy(&heap[h], 50, NULL);
+  }
+  for (i = 0; i < BULK; i++)
+    elems[0][i].val = elems[1][i].val = rand() % 20;
+
+  for (i = 0; i < BULK; i++) {
+    for (h = 0; h < 2; h++)
+      bheap_insert(&heap[h], &elems[h][i]);
+    live++;
+    if (i % 7 == 3 && i % 50 != 0) {
+      for (h = 0; h < 2; h++)
+        bheap_cancel(&heap[h], &elems[h][i - 1]);
+      live--;
+    }
+    if (i % 50 != 49) continue;
+    n = bheap_pop_many(&heap[0], out, rand() % 40);
+    live -= n;
+    for (j = 0; j < n; j++) {
+      struct mystr *p = bheap_pop(&heap[1]);
+      struct mystr *q = out[j];
+      if (!p || q - elems[0] != p - elems[1])
+        printf("Test failed: batch gave #%d, not #%d\n",
+               (int) (q - elems[0]), p ? (int) (p - elems[1]) : -1);
+    }
+  }
+  n = bheap_pop_many(&heap[0], out, BULK);
+  if (n != live)
+    printf("Test failed: final batch gave %lu, not %lu\n",
+           (unsigned long) n, (unsigned long) live);
+  for (i = 0; i < n; i++)
+    if ((struct mystr *) out[i] - elems[0] !=
+        (struct mystr *) bheap_pop(&heap[1]) - elems[1])
+      printf("Test failed: final batch differs at %lu\n", (unsigned long) i);
+  if (bheap_pop(&heap[1]))
+    printf("Test failed: batch left elements behind\n");
+}
+
+/* Cancelled elements must be reclaimed exactly once, and never
+   popped. */
+static struct mystr cancel_elems[BULK];
+static int cancel_state[BULK];
+
+static void reclaim(void *ctxt, void *p)
+{
+  int *st = &cancel_state[(struct mystr *) p - cancel_elems];
+  if (*st != 2)
+    printf("Test failed: reclaimed element in state %d\n", *st);
+  *st = 3;
+}
+
+static void test_cancel(unsigned percent)
+{
+  static void *top[BULK];
+  bheap heap;
+  struct mystr *p;
+  size_t i, live = 0;
+  ptrdiff_t k;
+  int lastval = -1;
+
+  bheap_init(&heap, struct mystr, links, NULL, &mycmp);
+  bheap_lazy(&heap, percent, &reclaim);
+  for (i = 0; i < BULK; i++) {
+    cancel_elems[i].val = rand() % 100;
+    cancel_state[i] = 1;
+    bheap_insert(&heap, &cancel_elems[i]);
+    live++;
+  }
+
+  /* Cancel two thirds, pop a few, and remove some directly. */
+  for (i = 0; i < BULK; i++) {
+    if (cancel_state[i] != 1) {
+      /* Already popped. */
+    } else if (i % 3 != 0) {
+      cancel_state[i] = 2;
+      bheap_cancel(&heap, &cancel_elems[i]);
+      live--;
+    } else if (i % 9 == 3) {
+      cancel_state[i] = 0;
+      bheap_remove(&heap, &cancel_elems[i]);
+      live--;
+    }
+    if (i % 50 == 0 && (p = bheap_pop(&heap))) {
+      if (cancel_state[p - cancel_elems] != 1)
+        printf("Test failed: popped element in state %d\n",
+               cancel_state[p - cancel_elems]);
+      cancel_state[p - cancel_elems] = 0;
+      live--;
+    }
+  }
+
+  k = bheap_topk(&heap, top, BULK);
+  if (k != (ptrdiff_t) live)
+    printf("Test failed: topk found %ld of %lu\n",
+           (long) k, (unsigned long) live);
+  while (k-- > 0)
+    if (cancel_state[(struct mystr *) top[k] - cancel_elems] != 1)
+      printf("Test failed: topk found cancelled element\n");
+
+  while ((p = bheap_pop(&heap))) {
+    if (cancel_state[p - cancel_elems] != 1)
+      printf("Test failed: popped element in state %d\n",
+             cancel_state[p - cancel_elems]);
+    if (p->val < lastval)
+      printf("Test failed: lazy heap yielded %d after %d\n",
+             p->val, lastval);
+    lastval = p->val;
+    cancel_state[p - cancel_elems] = 0;
+    live--;
+  }
+  if (live != 0 || heap.size != 0 || heap.dead != 0)
+    printf("Test failed: %lu live elements lost\n", (unsigned long) live);
+  for (i = 0; i < BULK; i++)
+    if (cancel_state[i] != 0 && cancel_state[i] != 3)
+      printf("Test failed: element %lu left in state %d\n",
+             (unsigned long) i, cancel_state[i]);
+}
+
+/* Equal elements must come out in the order they went in, even
+   through a rebuild. */
+static void test_fifo(void)
+{
+  static struct mystr elems[BULK];
+  static void *ptrs[BULK], *top[BULK];
+  bheap heap;
+  struct mystr *p, *prev = NULL;
+  size_t i;
+  ptrdiff_t k;
+
+  for (i = 0; i < BULK; i++) {
+    elems[i].val = rand() % 5;
+    ptrs[i] = &elems[i];
+  }
+  bheap_init(&heap, struct mystr, links, NULL, &mycmp);
+  bheap_fifo(&heap);
+  bheap_lazy(&heap, 10, NULL);
+  /* Start the numbering near its end, so that it wraps. */
+  heap.seq = ULONG_MAX - BULK / 2;
+  bheap_build(&heap, ptrs, BULK / 4);
+  for (i = BULK / 4; i < BULK / 2; i++)
+    bheap_insert(&heap, &elems[i]);
+  bheap_insert_many(&heap, ptrs + BULK / 2, BULK - BULK / 2);
+  for (i = 0; i < BULK; i += 4)
+    bheap_cancel(&heap, &elems[i]);
+  for (i = 1; i < BULK; i += 8)
+    bheap_remove(&heap, &elems[i]);
+
+  k = bheap_topk(&heap, top, 100);
+  for (i = 0; (ptrdiff_t) i < k; i++) {
+    p = bheap_pop(&heap);
+    if (p != top[i])
+      printf("Test failed: topk and pop disagree at %lu\n",
+             (unsigned long) i);
+  }
+  while ((p = bheap_pop(&heap))) {
+    if (prev && (prev->val > p->val || (prev->val == p->val && prev > p)))
+      printf("Test failed: %d (#%d) after %d (#%d)\n",
+             p->val, (int) (p - elems), prev->val, (int) (prev - elems));
+    prev = p;
+  }
+}
+
+/* Iteration must visit live elements in order, leaving the heap
+   untouched.  Ties are broken so that the order matches popping
+   exactly. */
+static void test_iter(void)
+{
+  static struct mystr elems[BULK];
+  static void *ptrs[BULK], *seen[BULK];
+  static bheap_elem before[BULK];
+  bheap heap, copy;
+  bheap_iter it;
+  struct mystr *p;
+  size_t i, n = 0;
+
+  for (i = 0; i < BULK; i++) {
+    elems[i].val = rand() % 100;
+    ptrs[i] = &elems[i];
+  }
+  bheap_init(&heap, struct mystr, links, NULL, &mycmp);
+  bheap_fifo(&heap);
+  bheap_lazy(&heap, 50, NULL);
+  bheap_build(&heap, ptrs, BULK);
+  for (i = 0; i < BULK; i += 5)
+    bheap_cancel(&heap, &elems[i]);
+  for (i = 0; i < BULK; i++)
+    before[i] = elems[i].links;
+  copy = heap;
+
+  /* Start small, so that the frontier must grow. */
+  if (bheap_iter_init(&it, &heap, 1) < 0) {
+    printf("Test failed: could not start iterator\n");
+    return;
+  }
+  while ((p = bheap_iter_next(&it)))
+    seen[n++] = p;
+  if (it.failed)
+    printf("Test failed: iterator ran out of memory\n");
+  bheap_iter_term(&it);
+
+  if (heap.first != copy.first || heap.last != copy.last ||
+      heap.size != copy.size)
+    printf("Test failed: iteration changed the heap\n");
+  for (i = 0; i < BULK; i++)
+    if (memcmp(&before[i], &elems[i].links, sizeof before[i]))
+      printf("Test failed: iteration changed element %lu\n",
+             (unsigned long) i);
+  if (n != BULK - BULK / 5)
+    printf("Test failed: iteration visited %lu\n", (unsigned long) n);
+  for (i = 0; i < n; i++)
+    if (bheap_pop(&heap) != seen[i])
+      printf("Test failed: iteration and pop differ at %lu\n",
+             (unsigned long) i);
+}
+
+/* Counters, if kept, must add up. */
+static void test_stats(void)
+{
+  static struct mystr elems[BULK];
+  bheap_counters st;
+  bheap heap;
+  size_t i;
+
+  bheap_init(&heap, struct mystr, links, NULL, &mycmp);
+  for (i = 0; i < BULK; i++) {
+    elems[i].val = rand() % 100;
+    bheap_insert(&heap, &elems[i]);
+  }
+  for (i = 0; i < BULK; i += 4)
+    bheap_remove(&heap, &elems[i]);
+  while (bheap_pop(&heap))
+    ;
+  if (bheap_stats(&heap, &st) < 0)
+    return;
+  if (st.inserts != BULK || st.removes != BULK / 4 ||
+      st.pops != BULK - BULK / 4)
+    printf("Test failed: counted %lu inserts, %lu removes, %lu pops\n",
+           st.inserts, st.removes, st.pops);
+  /* Removals also swap the last element into place. */
+  if (st.swaps < st.sift_steps ||
+      st.swaps > st.sift_steps + st.removes + st.pops || st.sift_max > 10 ||
+      st.sifts < BULK + BULK / 4 || st.compares < st.swaps)
+    printf("Test failed: counted %lu sifts of %lu steps, %lu swaps\n",
+           st.sifts, st.sift_steps, st.swaps);
+
+  /* Each update is one sift, and cancelled elements discarded from
+     the front are not pops. */
+  bheap_init(&heap, struct mystr, links, NULL, &mycmp);
+  bheap_lazy(&heap, 100, NULL);
+  for (i = 0; i < BULK; i++) {
+    elems[i].val = rand() % 100;
+    bheap_insert(&heap, &elems[i]);
+  }
+  for (i = 0; i < BULK; i += 3) {
+    elems[i].val = rand() % 100;
+    bheap_update(&heap, &elems[i]);
+  }
+  bheap_stats(&heap, &st);
+  if (st.sifts != BULK + (BULK + 2) / 3)
+    printf("Test failed: counted %lu sifts for updates\n", st.sifts);
+  for (i = 1; i < BULK; i += 3)
+    bheap_cancel(&heap, &elems[i]);
+  while (bheap_pop(&heap))
+    ;
+  bheap_stats(&heap, &st);
+  if (st.cancels != (BULK + 1) / 3 || st.reclaims != st.cancels ||
+      st.pops != BULK - st.cancels)
+    printf("Test failed: counted %lu cancels, %lu reclaims, %lu pops\n",
+           st.cancels, st.reclaims, st.pops);
+}
+
+static void test_typed(void)
+{
+  static struct ielem elems[BULK];
+  iheap_heap heap;
+  struct ielem *p;
+  size_t i, n = 0;
+  int lastval = -1;
+
+  iheap_init(&heap, NULL);
+  for (i = 0; i < BULK; i++) {
+    elems[i].val = rand() % 100;
+    iheap_insert(&heap, &elems[i]);
+  }
+  for (i = 0; i < BULK; i += 5)
+    iheap_remove(&heap, &elems[i]);
+  for (i = 1; i < BULK; i += 5) {
+    elems[i].val = rand() % 100;
+    iheap_update(&heap, &elems[i]);
+  }
+  while ((p = iheap_pop(&heap))) {
+    if (p->val < lastval)
+      printf("Test failed: typed heap yielded %d after %d\n",
+             p->val, lastval);
+    lastval = p->val;
+    n++;
+  }
+  if (n != BULK - BULK / 5)
+    printf("Test failed: typed heap yielded %lu\n", (unsigned long) n);
+}
+
 int main()
 {
   int lastval = 0;
@@ -94,5 +546,17 @@ int main()
     }
   }
 
+  test_bulk();
+  test_update();
+  test_batch();
+  test_batch_order();
+  test_cancel(0);
+  test_cancel(25);
+  test_cancel(100);
+  test_fifo();
+  test_iter();
+  test_stats();
+  test_typed();
+
   return 0;
 }
@@ -0,0 +1,186 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ddslib/kmerge.h"
+
+struct rec {
+  int key, run, seq;
+};
+
+static int mycmp(void *n, const void *v1, const void *v2)
+{
+  const struct rec *r1 = v1, *r2 = v2;
+  return r1->key < r2->key ? -1 : r1->key > r2->key;
+}
+
+#define ARRAYS 20
+#define MAXLEN 500
+
+/* A run generated on demand */
+struct counter {
+  struct rec r;
+  int limit;
+};
+
+static const void *count_next(void *ctxt)
+{
+  struct counter *c = ctxt;
+  if (c->r.key + 7 >= c->limit) return NULL;
+  c->r.key += 7;
+  c->r.seq++;
+  return &c->r;
+}
+
+static int intcmp(const void *a, const void *b)
+{
+  return mycmp(NULL, a, b);
+}
+
+int main()
+{
+  static struct rec arrays[ARRAYS][MAXLEN], filed[MAXLEN], out[64];
+  kmerge_run runs[ARRAYS + 2];
+  kmerge_array cursors[ARRAYS];
+  kmerge_file file;
+  struct counter counter;
+  kmerge merge;
+  struct rec last = { -1, -1, -1 };
+  size_t expected = 0, got = 0, n, i;
+  int r, j, failed = 0;
+  FILE *tmp;
+
+  srand(time(NULL));
+
+  for (r = 0; r < ARRAYS; r++) {
+    int len = rand() % MAXLEN;
+    if (r == 3) len = 0;
+    for (j = 0; j < len; j++)
+      arrays[r][j].key = rand() % 1000;
+    qsort(arrays[r], len, sizeof arrays[r][0], &intcmp);
+    for (j = 0; j < len; j++) {
+      arrays[r][j].run = r;
+      arrays[r][j].seq = j;
+    }
+    kmerge_array_init(&runs[r], &cursors[r], arrays[r], len,
+                      sizeof arrays[r][0]);
+    expected += len;
+  }
+
+  counter.r.key = -7;
+  counter.r.run = ARRAYS;
+  counter.r.seq = -1;
+  counter.limit = 990;
+  runs[ARRAYS].next = &count_next;
+  runs[ARRAYS].ctxt = &counter;
+  expected += 142;
+
+  /* Read the last run through a buffer much smaller than it. */
+  for (j = 0; j < MAXLEN; j++)
+    filed[j].key = rand() % 1000;
+  qsort(filed, MAXLEN, sizeof filed[0], &intcmp);
+  for (j = 0; j < MAXLEN; j++) {
+    filed[j].run = ARRAYS + 1;
+    filed[j].seq = j;
+  }
+  tmp = tmpfile();
+  if (!tmp || fwrite(filed, sizeof filed[0], MAXLEN, tmp) != MAXLEN ||
+      fflush(tmp) != 0 || lseek(fileno(tmp), 0, SEEK_SET) != 0) {
+    fprintf(stderr, "Could not write temporary file.\n");
+    return EXIT_FAILURE;
+  }
+  if (kmerge_file_init(&runs[ARRAYS + 1], &file, fileno(tmp),
+                       sizeof filed[0], 37) < 0) {
+    fprintf(stderr, "Could not allocate buffer.\n");
+    return EXIT_FAILURE;
+  }
+  expected += MAXLEN;
+
+  if (kmerge_init(&merge, runs, ARRAYS + 2, sizeof out[0],
+                  NULL, &mycmp) < 0) {
+    fprintf(stderr, "Could not allocate tree.\n");
+    return EXIT_FAILURE;
+  }
+
+  /* Mix single records and batches. */
+  do {
+    if (rand() % 3) {
+      n = kmerge_read(&merge, out, rand() % 64 + 1);
+    } else {
+      const struct rec *p = kmerge_next(&merge);
+      n = p != NULL;
+      if (p) out[0] = *p;
+    }
+    for (i = 0; i < n; i++) {
+      if (out[i].key < last.key ||
+          (out[i].key == last.key &&
+           (out[i].run < last.run ||
+            (out[i].run == last.run && out[i].seq <= last.seq)))) {
+        printf("Test failed: %d/%d/%d after %d/%d/%d\n",
+               out[i].key, out[i].run, out[i].seq,
+               last.key, last.run, last.seq);
+        failed = 1;
+      }
+      last = out[i];
+    }
+    got += n;
+  } while (n > 0);
+
+  if (got != expected) {
+    printf("Test failed: merged %lu of %lu\n",
+           (unsigned long) got, (unsigned long) expected);
+    failed = 1;
+  }
+  if (file.error) {
+    printf("Test failed: file error %d\n", file.error);
+    failed = 1;
+  }
+
+  kmerge_term(&merge);
+  kmerge_file_term(&file);
+  fclose(tmp);
+
+  /* A merge of nothing, and of one run */
+  if (kmerge_init(&merge, runs, 0, sizeof out[0], NULL, &mycmp) < 0 ||
+      kmerge_next(&merge) != NULL) {
+    printf("Test failed: empty merge\n");
+    failed = 1;
+  }
+  kmerge_term(&merge);
+  kmerge_array_init(&runs[0], &cursors[0], arrays[0], 5, sizeof out[0]);
+  if (kmerge_init(&merge, runs, 1, sizeof out[0], NULL, &mycmp) < 0 ||
+      kmerge_read(&merge, out, 64) != 5) {
+    printf("Test failed: single run\n");
+    failed = 1;
+  }
+  kmerge_term(&merge);
+
+  printf("All tests complete.\n");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "ddslib/mmheap.h"
+
+struct mystr {
+  mmheap_elem links;
+  int val;
+};
+
+static int mycmp(void *n, const void *v1, const void *v2)
+{
+  const struct mystr *m1 = v1, *m2 = v2;
+  return m1->val - m2->val;
+}
+
+#define COUNT 1000
+
+static struct mystr elems[COUNT];
+static int present[COUNT];
+static int failed;
+
+/* Check each element against its parent and grandparent. */
+static void check(mmheap *heap, const char *what)
+{
+  size_t i, a;
+  int depth, k;
+
+  for (i = 0; i < heap->size; i++) {
+    struct mystr *p = heap->base[i];
+    if (p->links.index != i) {
+      printf("Test failed: %s: element at %lu thinks it is at %lu\n", what,
+             (unsigned long) i, (unsigned long) p->links.index);
+      failed = 1;
+    }
+    for (a = i, k = 0; a > 0 && k < 2; k++) {
+      a = (a - 1) / 2;
+      for (depth = 0; (a + 1) >> (depth + 1); depth++)
+        ;
+      if (depth % 2 ? mycmp(NULL, heap->base[a], p) < 0
+          : mycmp(NULL, heap->base[a], p) > 0) {
+        printf("Test failed: %s: %d at %lu above %d at %lu\n", what,
+               ((struct mystr *) heap->base[a])->val, (unsigned long) a,
+               p->val, (unsigned long) i);
+        failed = 1;
+      }
+    }
+  }
+}
+
+/* Find the least or greatest element still present. */
+static int extreme(int max)
+{
+  int i, best = -1;
+  for (i = 0; i < COUNT; i++)
+    if (present[i] && (best < 0 || (max ? elems[i].val > elems[best].val
+                                    : elems[i].val < elems[best].val)))
+      best = i;
+  return best;
+}
+
+int main()
+{
+  static void *ptrs[COUNT];
+  mmheap heap;
+  int i, n;
+  struct mystr *p;
+
+  srand(time(NULL));
+
+  mmheap_init(&heap, struct mystr, links, NULL, &mycmp);
+  for (i = 0; i < COUNT; i++) {
+    elems[i].val = rand() % 500;
+    ptrs[i] = &elems[i];
+    present[i] = 1;
+  }
+  if (mmheap_build(&heap, ptrs, COUNT / 2) < 0) {
+    fprintf(stderr, "Could not grow heap.\n");
+    return EXIT_FAILURE;
+  }
+  check(&heap, "build");
+  for (i = COUNT / 2; i < COUNT; i++)
+    if (mmheap_insert(&heap, &elems[i]) < 0) {
+      fprintf(stderr, "Could not grow heap.\n");
+      return EXIT_FAILURE;
+    }
+  check(&heap, "insert");
+
+  /* Remove a third at random positions, using their handles. */
+  for (i = 0; i < COUNT; i += 3) {
+    mmheap_remove(&heap, &elems[i]);
+    present[i] = 0;
+    check(&heap, "remove");
+  }
+
+  /* Take from either end at random. */
+  for (n = 0; heap.size > 0; n++) {
+    int max = rand() % 2, want = extreme(max);
+    p = max ? mmheap_peek_max(&heap) : mmheap_peek_min(&heap);
+    if (p->val != elems[want].val) {
+      printf("Test failed: peek %s gave %d, not %d\n",
+             max ? "max" : "min", p->val, elems[want].val);
+      failed = 1;
+    }
+    if ((max ? mmheap_pop_max(&heap) : mmheap_pop_min(&heap)) != p) {
+      printf("Test failed: pop %s differs from peek\n", max ? "max" : "min");
+      failed = 1;
+    }
+    if (!present[p - elems]) {
+      printf("Test failed: removed element %d popped\n", (int) (p - elems));
+      failed = 1;
+    }
+    present[p - elems] = 0;
+    check(&heap, "pop");
+  }
+  if (mmheap_pop_min(&heap) || mmheap_pop_max(&heap) ||
+      mmheap_peek_min(&heap) || mmheap_peek_max(&heap)) {
+    printf("Test failed: empty heap yielded an element\n");
+    failed = 1;
+  }
+  for (i = 0; i < COUNT; i++)
+    if (present[i]) {
+      printf("Test failed: element %d lost\n", i);
+      failed = 1;
+    }
+
+  mmheap_term(&heap);
+  printf("All tests complete.\n");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "ddslib/mqueue.h"
+
+struct mystr {
+  bheap_elem links;
+  int val;
+  int popped;
+};
+
+static int mycmp(void *n, const void *v1, const void *v2)
+{
+  const struct mystr *m1 = v1, *m2 = v2;
+  return m1->val - m2->val;
+}
+
+#define THREADS 8
+#define PER_THREAD 20000
+
+static struct mystr elems[THREADS * PER_THREAD];
+static mqueue queue;
+
+static void *worker(void *arg)
+{
+  struct mystr *base = arg, *p;
+  unsigned seed = base - elems;
+  size_t i;
+
+  for (i = 0; i < PER_THREAD; i++) {
+    base[i].val = rand_r(&seed) % 1000;
+    mqueue_insert(&queue, &base[i]);
+  }
+  while ((p = mqueue_pop(&queue)))
+    __atomic_add_fetch(&p->popped, 1, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+int main()
+{
+  pthread_t threads[THREADS];
+  struct mystr *p;
+  int i, lastval, failed = 0;
+
+  /* With one heap, the order is exact. */
+  if (mqueue_init(&queue, struct mystr, links, NULL, &mycmp, 1) < 0) {
+    fprintf(stderr, "Could not create queue.\n");
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < 1000; i++) {
+    elems[i].val = rand() % 100;
+    mqueue_insert(&queue, &elems[i]);
+  }
+  for (lastval = -1; (p = mqueue_pop(&queue)); lastval = p->val)
+    if (p->val < lastval) {
+      printf("Test failed: %d after %d\n", p->val, lastval);
+      failed = 1;
+    }
+  mqueue_term(&queue);
+
+  /* With many, every element must be popped exactly once. */
+  if (mqueue_init(&queue, struct mystr, links, NULL, &mycmp,
+                  2 * THREADS) < 0) {
+    fprintf(stderr, "Could not create queue.\n");
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < THREADS; i++)
+    pthread_create(&threads[i], NULL, &worker, &elems[i * PER_THREAD]);
+  for (i = 0; i < THREADS; i++)
+    pthread_join(threads[i], NULL);
+  for (i = 0; i < THREADS * PER_THREAD; i++)
+    if (elems[i].popped != 1) {
+      printf("Test failed: element %d popped %d times\n", i, elems[i].popped);
+      failed = 1;
+    }
+  mqueue_term(&queue);
+
+  printf("All tests complete.\n");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ddslib/radixheap.h"
+
+struct myelem {
+  uint64_t key;
+  int queued;
+  radixheap_elem others;
+};
+
+#define COUNT 2000
+
+static struct myelem elems[COUNT];
+
+/* Each batch of ties must have the least key of those queued. */
+static int check_batch(void **batch, size_t n, uint64_t last)
+{
+  for (size_t i = 0; i < n; i++) {
+    struct myelem *p = batch[i];
+    if (p->key != ((struct myelem *) batch[0])->key || p->key < last) {
+      printf("Test failed: popped %llu after %llu\n",
+             (unsigned long long) p->key, (unsigned long long) last);
+      return -1;
+    }
+    if (!p->queued) {
+      printf("Test failed: popped element %d twice\n", (int) (p - elems));
+      return -1;
+    }
+    p->queued = 0;
+  }
+  for (size_t i = 0; i < COUNT; i++)
+    if (elems[i].queued && elems[i].key < last) {
+      printf("Test failed: %llu left behind at %llu\n",
+             (unsigned long long) elems[i].key, (unsigned long long) last);
+      return -1;
+    }
+  return 0;
+}
+
+int main()
+{
+  radixheap heap;
+  void *batch[COUNT];
+  uint64_t last = 0;
+  size_t queued = 0;
+  int i;
+
+  srand(time(NULL));
+  radixheap_init(&heap, struct myelem, others);
+  if (radixheap_pop(&heap) != NULL) {
+    printf("Test failed: empty heap yielded an element\n");
+    return EXIT_FAILURE;
+  }
+
+  /* Use a wide range of keys, some in the top bit, and many ties. */
+  for (i = 0; i < COUNT; i++) {
+    elems[i].key = (uint64_t) (rand() % 50) << (rand() % 58);
+    elems[i].queued = 1;
+    if (radixheap_insert(&heap, &elems[i], elems[i].key) < 0) {
+      printf("Test failed: insertion of %llu refused\n",
+             (unsigned long long) elems[i].key);
+      return EXIT_FAILURE;
+    }
+    queued++;
+  }
+  for (i = 0; i < COUNT; i += 7) {
+    radixheap_remove(&heap, &elems[i]);
+    elems[i].queued = 0;
+    queued--;
+  }
+
+  while (heap.size > 0) {
+    if (heap.size != queued) {
+      printf("Test failed: size %zu, expected %zu\n", heap.size, queued);
+      return EXIT_FAILURE;
+    }
+    size_t n;
+    if (rand() % 2) {
+      n = radixheap_pop_equal(&heap, batch, rand() % 4 + 1);
+    } else {
+      batch[0] = radixheap_pop(&heap);
+      n = 1;
+    }
+    if (check_batch(batch, n, last) < 0)
+      return EXIT_FAILURE;
+    last = ((struct myelem *) batch[0])->key;
+    queued -= n;
+
+    /* Put some back later, and bring others forward. */
+    for (size_t j = 0; j < n; j++) {
+      struct myelem *p = batch[j];
+      if (rand() % 3 == 0) continue;
+      p->key = last + (rand() % 4 ? (uint64_t) rand() % 1000 : 0);
+      if (radixheap_insert(&heap, p, p->key) < 0) {
+        printf("Test failed: reinsertion of %llu refused\n",
+               (unsigned long long) p->key);
+        return EXIT_FAILURE;
+      }
+      p->queued = 1;
+      queued++;
+    }
+    struct myelem *q = &elems[rand() % COUNT];
+    if (q->queued) {
+      uint64_t k = last + (q->key - last) / 2;
+      if (radixheap_decrease(&heap, q, k) < 0) {
+        printf("Test failed: decrease to %llu refused\n",
+               (unsigned long long) k);
+        return EXIT_FAILURE;
+      }
+      q->key = k;
+      if (radixheap_decrease(&heap, q, k + 1) == 0) {
+        printf("Test failed: increase accepted\n");
+        return EXIT_FAILURE;
+      }
+    }
+    if (last > 0 && radixheap_insert(&heap, q->queued ? &elems[0] : q,
+                                     last - 1) == 0) {
+      printf("Test failed: insertion below %llu accepted\n",
+             (unsigned long long) last);
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("All tests complete.\n");
+  return EXIT_SUCCESS;
+}
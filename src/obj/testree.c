@@ -24,6 +24,8 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <assert.h>
 
 #include "ddslib/btree.h"
@@ -37,6 +39,15 @@ struct element {
   number_elem others;
 };
 
+struct rbelement;
+
+btree_DECL(rbnum, struct rbelement, int);
+
+struct rbelement {
+  int value;
+  rbnum_elem others;
+};
+
 void print_tree(struct element *root)
 {
   int i;
@@ -57,10 +68,99 @@ void print_tree(struct element *root)
   }
 }
 
-int main()
+static int height(struct rbelement *np)
+{
+  int l, r;
+
+  if (!np)
+    return 0;
+  l = height(rbnum_child(np, btree_LEFT));
+  r = height(rbnum_child(np, btree_RIGHT));
+  return 1 + (l > r ? l : r);
+}
+
+/* Walk the tree in both directions, expecting n elements in order. */
+static int walk(struct rbelement *root, int n)
+{
+  struct rbelement *np, *last;
+  int got, dir, failed = 0;
+
+  for (dir = 0; dir < 2; dir++) {
+    if (!root) break;
+    for (np = root; rbnum_child(np, btree_opp(dir)); )
+      np = rbnum_child(np, btree_opp(dir));
+    for (got = 0, last = NULL; np; np = rbnum_next(np, dir), got++) {
+      if (last && (dir ? last->value >= np->value
+                   : last->value <= np->value)) {
+        printf("Test failed: %d after %d\n", np->value, last->value);
+        failed = 1;
+      }
+      last = np;
+    }
+    if (got != n) {
+      printf("Test failed: walked %d of %d\n", got, n);
+      failed = 1;
+    }
+  }
+  return failed;
+}
+
+#define RBCOUNT 1000
+
+/* Sorted insertions must still give a shallow tree. */
+static int test_balanced(void)
+{
+  static struct rbelement elems[RBCOUNT];
+  struct rbelement *root = NULL, *found;
+  int i, n, failed = 0;
+
+  for (i = 0; i < RBCOUNT; i++) {
+    elems[i].value = i;
+    rbnum_init(&elems[i]);
+    rbnum_find(NULL, &root, elems[i].value, rbnum_links(&elems[i]), NULL);
+    rbnum_link(&elems[i]);
+    rbnum_check(root);
+  }
+  if (height(root) > 2 * 10) {
+    printf("Test failed: height %d for %d elements\n", height(root),
+           RBCOUNT);
+    failed = 1;
+  }
+  failed |= walk(root, RBCOUNT);
+
+  /* Remove half at random, then the rest in order. */
+  for (i = 0, n = RBCOUNT; i < RBCOUNT; i++)
+    if (rand() % 2) {
+      rbnum_remove(&elems[i], NULL);
+      elems[i].value = -1;
+      rbnum_check(root);
+      n--;
+    }
+  failed |= walk(root, n);
+  for (i = 0; i < RBCOUNT; i++) {
+    found = *rbnum_find(NULL, &root, i, NULL, NULL)->holder;
+    if ((found != NULL) != (elems[i].value >= 0)) {
+      printf("Test failed: %d %sfound\n", i, found ? "" : "not ");
+      failed = 1;
+    }
+  }
+  for (i = 0; i < RBCOUNT; i++)
+    if (elems[i].value >= 0) {
+      rbnum_remove(&elems[i], NULL);
+      rbnum_check(root);
+    }
+  if (root) {
+    printf("Test failed: tree not empty\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+int main(int argc, const char *const *argv)
 {
   struct element *root = NULL;
   struct element a, b, c, d, e, f;
+  unsigned seed;
 
   a.value = 7;
   b.value = 9;
@@ -138,9 +238,18 @@ int main()
   putchar('\n');
   number_check(root);
 
+  /* Report the seed, so that a failure can be repeated by passing it
+     back. */
+  seed = argc > 1 ? strtoul(argv[1], NULL, 0) : time(NULL);
+  printf("Seed: %u\n", seed);
+  srand(seed);
+  if (test_balanced())
+    return EXIT_FAILURE;
+
   return 0;
 }
 
 #define MYCMP(A,B,C) ((B)-(C))
 
 btree_IMPL(number, struct element, int, others, value, MYCMP);
+btree_RBIMPL(rbnum, struct rbelement, int, others, value, MYCMP);
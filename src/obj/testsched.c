@@ -0,0 +1,134 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ddslib/sched.h"
+
+#define COUNT 300
+#define MS 1000000u
+
+struct myevent {
+  sched_event ev;
+  int fired, repeats;
+};
+
+static sched s;
+static struct myevent events[COUNT];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t lastwhen;
+static int failed, outstanding;
+
+/* Events run on the dispatching thread, in order, no earlier than
+   they are due. */
+static void fire(void *ctxt)
+{
+  struct myevent *e = ctxt;
+  uint64_t now = sched_now();
+
+  pthread_mutex_lock(&lock);
+  if (now < e->ev.when) {
+    printf("Test failed: event %d ran %lu ns early\n", (int) (e - events),
+           (unsigned long) (e->ev.when - now));
+    failed = 1;
+  }
+  if (e->ev.when < lastwhen) {
+    printf("Test failed: event %d ran out of order\n", (int) (e - events));
+    failed = 1;
+  }
+  lastwhen = e->ev.when;
+  e->fired++;
+  pthread_mutex_unlock(&lock);
+
+  /* Some repeat themselves. */
+  if (e->repeats > 0) {
+    e->repeats--;
+    sched_after(&s, &e->ev, MS);
+  } else {
+    pthread_mutex_lock(&lock);
+    outstanding--;
+    pthread_mutex_unlock(&lock);
+  }
+}
+
+int main()
+{
+  uint64_t start;
+  int i, expected[COUNT], spins;
+
+  srand(time(NULL));
+  if (sched_init(&s) < 0) {
+    fprintf(stderr, "Could not start scheduler.\n");
+    return EXIT_FAILURE;
+  }
+
+  start = sched_now();
+  for (i = 0; i < COUNT; i++) {
+    sched_event_init(&events[i].ev, &fire, &events[i]);
+    events[i].fired = 0;
+    events[i].repeats = i % 10 == 0 ? 3 : 0;
+    expected[i] = events[i].repeats + 1;
+  }
+  pthread_mutex_lock(&lock);
+  outstanding = COUNT;
+  pthread_mutex_unlock(&lock);
+  for (i = 0; i < COUNT; i++)
+    sched_at(&s, &events[i].ev, start + 100 * MS + rand() % (50 * MS));
+
+  /* Withdraw some, and move others, before any is due. */
+  for (i = 1; i < COUNT; i += 7)
+    if (sched_cancel(&s, &events[i].ev)) {
+      expected[i] = 0;
+      pthread_mutex_lock(&lock);
+      outstanding--;
+      pthread_mutex_unlock(&lock);
+    }
+  for (i = 2; i < COUNT; i += 7)
+    sched_after(&s, &events[i].ev, rand() % (30 * MS));
+
+  for (spins = 0; spins < 500; spins++) {
+    struct timespec ts = { 0, 10 * MS };
+    int left;
+    pthread_mutex_lock(&lock);
+    left = outstanding;
+    pthread_mutex_unlock(&lock);
+    if (left == 0) break;
+    nanosleep(&ts, NULL);
+  }
+  sched_sync(&s);
+  sched_term(&s);
+
+  for (i = 0; i < COUNT; i++)
+    if (events[i].fired != expected[i]) {
+      printf("Test failed: event %d ran %d times, not %d\n",
+             i, events[i].fired, expected[i]);
+      failed = 1;
+    }
+  printf("All tests complete.\n");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
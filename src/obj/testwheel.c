@@ -0,0 +1,116 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ddslib/twheel.h"
+
+struct mytimer {
+  uint64_t due;
+  int fired;
+  twheel_elem links;
+};
+
+#define COUNT 5000
+
+static struct mytimer timers[COUNT];
+static uint64_t lower, upper;
+static int failed;
+
+/* Each timer must expire during the advance that covers its tick. */
+static void fire(void *ctxt, void *p)
+{
+  struct mytimer *t = p;
+  uint64_t due = t->due > lower ? t->due : lower + 1;
+  if (due <= lower || due > upper) {
+    printf("Test failed: timer due at %llu fired in (%llu, %llu]\n",
+           (unsigned long long) t->due, (unsigned long long) lower,
+           (unsigned long long) upper);
+    failed = 1;
+  }
+  t->fired++;
+}
+
+static void run(unsigned bits, unsigned levels, uint64_t range)
+{
+  twheel wheel;
+  int i;
+
+  if (twheel_init(&wheel, struct mytimer, links, bits, levels, 1000) < 0) {
+    printf("Test failed: could not set up %u x %u wheel\n", bits, levels);
+    failed = 1;
+    return;
+  }
+  for (i = 0; i < COUNT; i++) {
+    timers[i].links.slot = NULL;
+    timers[i].fired = 0;
+    timers[i].due = 1000 + (uint64_t) rand() * rand() % range;
+    twheel_schedule(&wheel, &timers[i], timers[i].due);
+  }
+
+  /* Cancel some, and move others. */
+  for (i = 0; i < COUNT; i += 3)
+    twheel_cancel(&wheel, &timers[i]);
+  for (i = 1; i < COUNT; i += 3) {
+    timers[i].due = 1000 + (uint64_t) rand() * rand() % range;
+    twheel_schedule(&wheel, &timers[i], timers[i].due);
+  }
+
+  lower = twheel_now(&wheel);
+  while (wheel.size > 0) {
+    uint64_t next = twheel_next(&wheel);
+    if (next <= lower) {
+      printf("Test failed: next tick %llu is not after %llu\n",
+             (unsigned long long) next, (unsigned long long) lower);
+      failed = 1;
+      break;
+    }
+    upper = lower + rand() % (range / 50 + 1) + 1;
+    twheel_advance(&wheel, upper, &fire, NULL);
+    lower = upper;
+  }
+
+  for (i = 0; i < COUNT; i++)
+    if (timers[i].fired != (i % 3 != 0)) {
+      printf("Test failed: timer %d fired %d times (%u x %u)\n",
+             i, timers[i].fired, bits, levels);
+      failed = 1;
+    }
+  twheel_term(&wheel);
+}
+
+int main()
+{
+  srand(time(NULL));
+  run(8, 4, 1000000);
+  run(4, 3, 100000);
+  run(6, 1, 500);
+  run(2, 2, 1000);
+  printf("All tests complete.\n");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
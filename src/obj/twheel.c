@@ -0,0 +1,248 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ * DDSLib: Dynamic data structures
+ * Copyright (C) 2002-3,2005-6,2012,2016  Steven Simpson
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+ * USA
+ *
+ *
+ * Author contact: Email to s.simpson at lancaster.ac.uk
+ */
+
+#include <stdlib.h>
+
+#include "ddslib/twheel.h"
+
+#define get_elem(R,O) ((twheel_elem *) ((char *) (O) + (R)->memb))
+#define get_obj(R,E) ((void *) ((char *) (E) - (R)->memb))
+
+#define MASK(R) (((uint64_t) 1 << (R)->bits) - 1)
+
+int twheel_setup(twheel *r, size_t memb, unsigned bits, unsigned levels,
+                 uint64_t now)
+{
+  size_t n, i;
+
+  if (bits < 1 || bits > 16 || levels < 1 || bits * levels > 64)
+    return -1;
+
+  r->memb = memb;
+  r->bits = bits;
+  r->levels = levels;
+  r->words = ((1u << bits) + 63) / 64;
+  r->now = now;
+  r->size = 0;
+  dllist_init(&r->due);
+
+  n = (size_t) levels << bits;
+  r->slots = malloc(n * sizeof r->slots[0]);
+  r->occupied = calloc(levels * r->words, sizeof r->occupied[0]);
+  if (!r->slots || !r->occupied) {
+    free(r->slots);
+    free(r->occupied);
+    return -1;
+  }
+  for (i = 0; i < n; i++)
+    dllist_init(&r->slots[i]);
+  return 0;
+}
+
+void twheel_term(twheel *r)
+{
+  free(r->slots);
+  free(r->occupied);
+  r->slots = NULL;
+  r->occupied = NULL;
+}
+
+static inline void set_bit(twheel *r, size_t i)
+{
+  unsigned lvl = i >> r->bits;
+  size_t j = i & MASK(r);
+  r->occupied[lvl * r->words + j / 64] |= (uint64_t) 1 << (j % 64);
+}
+
+static inline void clear_bit(twheel *r, size_t i)
+{
+  unsigned lvl = i >> r->bits;
+  size_t j = i & MASK(r);
+  r->occupied[lvl * r->words + j / 64] &= ~((uint64_t) 1 << (j % 64));
+}
+
+static inline unsigned ctz(uint64_t x)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll(x);
+#else
+  unsigned r = 0;
+  for ( ; !(x & 1); x >>= 1)
+    r++;
+  return r;
+#endif
+}
+
+/* Find how many slots ahead of the given one the next occupied slot
+   of a level is, cyclically, or return 2^bits if there is none.  Bits
+   beyond the last slot of a word are never set. */
+static uint64_t next_occupied(const twheel *r, unsigned lvl, uint64_t from)
+{
+  const uint64_t *w = r->occupied + lvl * r->words;
+  uint64_t n = MASK(r) + 1, width = n < 64 ? n : 64;
+  for (uint64_t k = 0; k < n; ) {
+    uint64_t j = (from + k) & MASK(r);
+    uint64_t bits = w[j / 64] >> (j % 64);
+    if (bits)
+      return k + ctz(bits);
+    k += width - j % 64;
+  }
+  return n;
+}
+
+static void unlink_elem(twheel *r, twheel_elem *e)
+{
+  twheel_slot *s = e->slot;
+  dllist_unlink(s, others, e);
+  e->slot = NULL;
+  if (s != &r->due && dllist_isempty(s))
+    clear_bit(r, s - r->slots);
+}
+
+/* Put a timer in the slot of the lowest level whose span covers it,
+   or the highest level if none does. */
+static void place(twheel *r, twheel_elem *e)
+{
+  uint64_t when = e->when > r->now ? e->when : r->now + 1;
+  uint64_t delta = when - r->now;
+  unsigned lvl = 0;
+  while (lvl + 1 < r->levels && delta >> (r->bits * (lvl + 1)))
+    lvl++;
+  if (lvl + 1 == r->levels && r->bits * r->levels < 64 &&
+      delta >> (r->bits * r->levels))
+    when = r->now + ((uint64_t) 1 << (r->bits * r->levels)) - 1;
+
+  size_t i = ((size_t) lvl << r->bits) +
+    ((when >> (r->bits * lvl)) & MASK(r));
+  e->slot = &r->slots[i];
+  dllist_append(e->slot, others, e);
+  set_bit(r, i);
+}
+
+void twheel_schedule(twheel *r, void *p, uint64_t when)
+{
+  twheel_elem *e = get_elem(r, p);
+  if (e->slot)
+    unlink_elem(r, e);
+  else
+    r->size++;
+  e->when = when;
+  place(r, e);
+}
+
+void twheel_cancel(twheel *r, void *p)
+{
+  twheel_elem *e = get_elem(r, p);
+  if (!e->slot) return;
+  unlink_elem(r, e);
+  r->size--;
+}
+
+/* Find the next tick at which an occupied slot is visited. */
+static uint64_t next_visit(twheel *r)
+{
+  uint64_t best = UINT64_MAX, t = r->now + 1;
+
+  /* Level l slots are visited at ticks that are multiples of
+     2^(bits*l). */
+  for (unsigned lvl = 0; lvl < r->levels; lvl++) {
+    unsigned shift = r->bits * lvl;
+    uint64_t start = t;
+    if (shift > 0) {
+      uint64_t span = (uint64_t) 1 << shift;
+      start = (t + span - 1) & ~(span - 1);
+      if (start < t) continue;
+    }
+    uint64_t k = next_occupied(r, lvl, (start >> shift) & MASK(r));
+    if (k > MASK(r) || k > (UINT64_MAX - start) >> shift) continue;
+    uint64_t cand = start + (k << shift);
+    if (cand < best)
+      best = cand;
+  }
+  return best;
+}
+
+uint64_t twheel_next(twheel *r)
+{
+  if (!dllist_isempty(&r->due))
+    return r->now;
+  return next_visit(r);
+}
+
+/* Visit the slots due at a tick, from the highest level down,
+   replacing timers from higher levels, and collecting those that
+   expire. */
+static void visit(twheel *r, uint64_t t)
+{
+  unsigned top = 0;
+  while (top + 1 < r->levels &&
+         (t & (((uint64_t) 1 << (r->bits * (top + 1))) - 1)) == 0)
+    top++;
+
+  for (unsigned lvl = top + 1; lvl-- > 0; ) {
+    size_t i = ((size_t) lvl << r->bits) +
+      ((t >> (r->bits * lvl)) & MASK(r));
+    twheel_slot tmp = r->slots[i];
+    twheel_elem *e;
+    if (dllist_isempty(&tmp)) continue;
+    dllist_init(&r->slots[i]);
+    clear_bit(r, i);
+    while ((e = dllist_first(&tmp))) {
+      dllist_unlink(&tmp, others, e);
+      if (e->when <= t) {
+        e->slot = &r->due;
+        dllist_append(&r->due, others, e);
+      } else {
+        place(r, e);
+      }
+    }
+  }
+}
+
+size_t twheel_advance(twheel *r, uint64_t to,
+                      void (*fire)(void *ctxt, void *), void *ctxt)
+{
+  size_t count = 0;
+  twheel_elem *e;
+
+  while (r->now < to) {
+    uint64_t t = next_visit(r);
+    if (t > to) {
+      r->now = to;
+      break;
+    }
+    r->now = t;
+    visit(r, t);
+  }
+
+  while ((e = dllist_first(&r->due))) {
+    dllist_unlink(&r->due, others, e);
+    e->slot = NULL;
+    r->size--;
+    count++;
+    (*fire)(ctxt, get_obj(r, e));
+  }
+  return count;
+}